@@ -1,3 +1,10 @@
+import os
+import sys
+
+# Native key recovery of the simulator tree (simfrcon/dfanative.py)
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "simfrcon"))
+import dfanative
+
 # Constants
 RCON = [
     0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36
@@ -98,7 +105,7 @@ def inverse_key_schedule(key):
     
     return round_keys
 
-def keyrecover(fcpts, ccpts, N=3):
+def keyrecover_python(fcpts, ccpts, N=3):
     assert N == len(ccpts)
     assert N == len(fcpts)
 
@@ -405,4 +412,8 @@ def keyrecover(fcpts, ccpts, N=3):
     for i in range(16): 
         print(f"{round_keys[i]:02x} ", end="")
     print()
-    return True
\ No newline at end of file
+    return True
+
+def keyrecover(fcpts, ccpts, N=3, threads=None):
+    """Native recovery of simfrcon/faultingrcon/libdfa.so if it is built, keyrecover_python() otherwise"""
+    return dfanative.keyrecover(fcpts, ccpts, keyrecover_python, N, threads)
@@ -89,6 +89,7 @@ void platform_init(void);
 #define HAL_neorv32  28
 #define HAL_sam4s  29
 #define HAL_ibex  30
+#define HAL_linux  31
 
 #if HAL_TYPE == HAL_avr
     #include <avr/io.h>
@@ -160,6 +161,8 @@ void platform_init(void);
     #include "sam4s/sam4s_hal.h"
 #elif HAL_TYPE == HAL_ibex
     #include "ibex/ibex_hal.h"
+#elif HAL_TYPE == HAL_linux
+    #include "linux/linux_hal.h"
 #else
     #error "Unsupported HAL Type"
 #endif
@@ -204,4 +207,10 @@ void platform_init(void);
 #define led_ok(a)
 #endif
 
+//Faulted statement of the glitch window, skipped at loop index i by hal/linux;
+//on hardware it is the statement itself
+#ifndef HAL_FAULT_SKIP
+#define HAL_FAULT_SKIP(i, stmt) stmt
+#endif
+
 #endif //HAL_H_
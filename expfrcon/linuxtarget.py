@@ -0,0 +1,88 @@
+"""simpleserial-glitch built for hal/linux, as a local stand-in target.
+
+    cd simpleserial-glitch && make PLATFORM=LINUX && cd ..
+    python3 linuxtarget.py --location 7 -n 3000 --depth 8
+
+starts the firmware process with the round constant of iteration `location`
+skipped, checks its ciphertexts against the reference AES of ssemu.py and
+reports the throughput, then recovers the key from the plaintexts of plts.txt
+as run.py does.
+"""
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+# SimpleSerial acquisition of the S-box experiment (expfsbox/acquisition.py)
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "expfsbox"))
+from acquisition import FdTransport, Pipeline
+from analyze import RCON, keyrecover
+from ssemu import AES, KEY
+
+# FIRMWARE overrides the path of the executable
+FIRMWARE = os.environ.get("FIRMWARE") or os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "simpleserial-glitch", "simpleserial-glitch-LINUX.elf")
+
+
+class LinuxTarget:
+    """Firmware process with its PTY opened as `self.transport`"""
+
+    def __init__(self, firmware=FIRMWARE, location=-1):
+        self.tmp = tempfile.TemporaryDirectory()
+        link = os.path.join(self.tmp.name, "tty")
+        env = dict(os.environ, HAL_PTY_LINK=link, HAL_FAULT_LOCATION=str(location),
+                   HAL_TRIGGER_LOG=os.path.join(self.tmp.name, "trigger"))
+        self.proc = subprocess.Popen([firmware], env=env, stderr=subprocess.DEVNULL)
+        while not os.path.exists(link):
+            if self.proc.poll() is not None:
+                raise RuntimeError(f"{firmware} exited with {self.proc.returncode}")
+            time.sleep(0.01)
+        self.transport = FdTransport.open(link)
+
+    def trigger_windows(self):
+        """Durations of the trigger windows so far, in ns"""
+        with open(os.path.join(self.tmp.name, "trigger")) as f:
+            return [int(line) for line in f if line.strip()]
+
+    def close(self):
+        self.transport.close()
+        self.proc.kill()
+        self.proc.wait()
+        self.tmp.cleanup()
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-n', dest='N', type=int, default=3000, help='Number of ciphertexts')
+    parser.add_argument('--depth', type=int, default=8, help='Requests in flight')
+    parser.add_argument('--location', type=int, default=7,
+                        help='Skipped round constant iteration (-1: no fault)')
+    config = parser.parse_args()
+
+    target = LinuxTarget(location=config.location)
+    pipe = Pipeline(target.transport, depth=config.depth)
+    pipe.flush()
+
+    # the skipped store leaves the zero of the static table
+    rcon = list(RCON)
+    if config.location >= 0:
+        rcon[config.location] = 0
+    ref = AES(KEY, rcon=rcon)
+
+    plts = [os.urandom(16) for _ in range(config.N)]
+    start = time.monotonic()
+    results = pipe.run('a', plts, 16)
+    elapsed = time.monotonic() - start
+    good = sum(r['valid'] and r['payload'] == ref.encrypt(p) for r, p in zip(results, plts))
+    print(f"a: {good}/{config.N} ciphertexts correct, {config.N / elapsed:.0f} commands/s (depth {config.depth})")
+    print(f"trigger windows (ns): {target.trigger_windows()}")
+
+    with open("plts.txt", "r") as f: plts = [bytes.fromhex(p.strip()) for p in f]
+    with open("ccpts.txt", "r") as f: ccpts = [list(bytes.fromhex(c.strip())) for c in f]
+    fcpts = [list(r['payload']) for r in pipe.run('a', plts, 16)]
+    if config.location >= 0:
+        keyrecover(fcpts, ccpts)
+    target.close()
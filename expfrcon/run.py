@@ -1,7 +1,12 @@
-from analyze import keyrecover
 import chipwhisperer as cw
 import time
 import os
+import sys
+from analyze import keyrecover
+# SimpleSerial acquisition and glitch search of the S-box experiment (expfsbox)
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "expfsbox"))
+from acquisition import Pipeline, CWTransport
+from glitchsearch import GlitchSearch
 
 def reboot_flush(scope, target):            
     scope.io.nrst = False
@@ -13,12 +18,9 @@ def reboot_flush(scope, target):
 
 def check_good_fault(plts, ccpts, N=3):
     fcpts = []
-    for i in range(N):
-        print(f"Encrypting for recovery: {i:4d}")
-        plt = bytearray(plts[i])
-        target.simpleserial_write('a', plt)
-        time.sleep(0.1)
-        response = target.simpleserial_read_witherrors('r', 16, glitch_timeout=10, timeout=50)
+    print(f"Encrypting {N} plaintexts for recovery")
+    results = Pipeline(CWTransport(target)).run('a', [bytes(p) for p in plts[:N]], 16)
+    for response in results:
         if response['valid'] is False:
             gc.add('reset')
         else:
@@ -66,6 +68,8 @@ if __name__ == "__main__":
     gc.set_range("ext_offset", 70, 100)
     gc.set_global_step(0.4)
     gc.set_step("ext_offset", 1)
+    # same grid, visited adaptively; trials.jsonl lets an interrupted run resume
+    search = GlitchSearch({"width": (1.6, 3.6, 0.4), "offset": (-3.6, -2, 0.4), "ext_offset": (70, 100, 1)}, log="trials.jsonl")
     scope.glitch.repeat = 1
 
     reboot_flush(scope, target)
@@ -78,7 +82,7 @@ if __name__ == "__main__":
     ccpts = [list(bytes.fromhex(c.strip())) for c in ccpts]
 
     # BEGIN GLITCH
-    for glitch_setting in gc.glitch_values():
+    for glitch_setting in search.glitch_values(max_trials=20000):
         print(f"O = {glitch_setting[1]}, W = {glitch_setting[0]}, E = {glitch_setting[2]}")
         scope.glitch.offset = glitch_setting[1]
         scope.glitch.width = glitch_setting[0]
@@ -97,11 +101,13 @@ if __name__ == "__main__":
         if ret:
             print("[RESET] Timeout, no trigger!")
             gc.add("reset")
+            search.add("reset")
             reboot_flush(scope, target)
         else:
             response = target.simpleserial_read_witherrors('r', 16, glitch_timeout=10, timeout=50)
             if response['valid'] is False:
                 gc.add('reset')
+                search.add("reset")
                 reboot_flush(scope, target)
             else:
                 rcon = list(response['payload'])
@@ -111,10 +117,12 @@ if __name__ == "__main__":
 
                 is_goodfault = check_good_fault(plts, ccpts)
                 if is_goodfault:
+                    search.add("success")
                     print("Good fault! Finish!")
                     break
                 else:
                     print("Fault is not good! Try again with a new fault!")
+                    search.add("normal")
                     reboot_flush(scope, target)
             
     scope.dis()
@@ -0,0 +1,155 @@
+"""Emulated simpleserial-glitch target on a pseudo-terminal.
+
+Serves the 'v' and 'a' commands of simpleserial-glitch.c over the slave side
+of a PTY, with an AES whose S-box and round constants can be faulted, so
+../expfsbox/acquisition.py can be exercised without a ChipWhisperer:
+
+    python3 ssemu.py -n 3000 --depth 8 --rcon-fault 9:0x01
+"""
+import argparse
+import os
+import queue
+import sys
+import threading
+import time
+import tty
+
+# SimpleSerial acquisition of the S-box experiment (expfsbox/acquisition.py)
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "expfsbox"))
+from acquisition import FRAME_BYTE, FdTransport, Pipeline, ss_crc, stuff, unstuff
+from analyze import SBOX as S, RCON
+
+KEY = bytes.fromhex('5b12a47f2b5571191ec06d7c02fc6076')
+
+
+def xtime(a):
+    return ((a << 1) ^ 0x1B) & 0xFF if a & 0x80 else a << 1
+
+
+class AES:
+    """AES-128 encryption with the S-box and Rcon given as data"""
+
+    def __init__(self, key, sbox=S, rcon=RCON):
+        self.sbox = list(sbox)
+        w = list(key)
+        for r in range(10):
+            # SubWord(RotWord(last word)) ^ Rcon, then the running xor
+            t = [self.sbox[w[-3]] ^ rcon[r], self.sbox[w[-2]], self.sbox[w[-1]], self.sbox[w[-4]]]
+            for j in range(16):
+                w.append(w[-16] ^ (t[j] if j < 4 else w[-4]))
+        self.rk = [w[16 * r:16 * r + 16] for r in range(11)]
+
+    def encrypt(self, pt):
+        s = [p ^ k for p, k in zip(pt, self.rk[0])]
+        for r in range(1, 11):
+            s = [self.sbox[b] for b in s]
+            s = [s[(i + 4 * (i % 4)) % 16] for i in range(16)]     # ShiftRows
+            if r < 10:
+                m = []
+                for c in range(4):
+                    a = s[4 * c:4 * c + 4]
+                    x = a[0] ^ a[1] ^ a[2] ^ a[3]
+                    m += [a[i] ^ x ^ xtime(a[i] ^ a[(i + 1) % 4]) for i in range(4)]
+                s = m
+            s = [b ^ k for b, k in zip(s, self.rk[r])]
+        return bytes(s)
+
+
+class EmulatedTarget:
+    """simpleserial-glitch.c on the slave side of a PTY, served by a thread.
+
+    `latency` is added to every command to mimic the time of the target and
+    the replies reach the host `link_delay` seconds after they are sent, as
+    through the USB bridge of the ChipWhisperer.
+    """
+
+    def __init__(self, key=KEY, sbox=S, rcon=RCON, latency=0.0, link_delay=0.0):
+        self.aes = AES(key, sbox, rcon)
+        self.latency = latency
+        self.link_delay = link_delay
+        self.outbox = queue.Queue()
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.master)
+        tty.setraw(self.slave)
+        self.thread = threading.Thread(target=self._serve, daemon=True)
+        self.thread.start()
+        self.writer = threading.Thread(target=self._deliver, daemon=True)
+        self.writer.start()
+
+    def _put(self, c, data):
+        body = bytes([ord(c), len(data)]) + bytes(data)
+        self.outbox.put((time.monotonic() + self.link_delay, stuff(body + bytes([ss_crc(body)]))))
+
+    def _deliver(self):
+        while True:
+            due, frame = self.outbox.get()
+            wait = due - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+            try:
+                os.write(self.slave, frame)
+            except OSError:
+                return
+
+    def _handle(self, cmd, data):
+        if self.latency:
+            time.sleep(self.latency)
+        if cmd == 'v':
+            self._put('r', bytes([3]))
+        elif cmd == 'a' and len(data) == 16:
+            self._put('r', self.aes.encrypt(data))
+        else:
+            return 0x01     # SS_ERR_CMD
+        return 0
+
+    def _serve(self):
+        buf = bytearray()
+        while True:
+            try:
+                buf += os.read(self.slave, 4096)
+            except OSError:
+                return
+            while FRAME_BYTE in buf:
+                end = buf.index(FRAME_BYTE)
+                body = unstuff(bytes(buf[:end + 1]))
+                del buf[:end + 1]
+                if body is None or len(body) < 4 or body[2] != len(body) - 4 \
+                        or ss_crc(body[:-1]) != body[-1]:
+                    self._put('e', bytes([0x04]))   # SS_ERR_CRC
+                    continue
+                rv = self._handle(chr(body[0]), body[3:-1])
+                self._put('e', bytes([rv]))
+
+    def close(self):
+        os.close(self.master)
+        os.close(self.slave)
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-n', dest='N', type=int, default=3000, help='Number of ciphertexts')
+    parser.add_argument('--depth', type=int, default=8, help='Requests in flight')
+    parser.add_argument('--rcon-fault', dest='rcon_fault', type=str, default='',
+                        help='Round constant fault as ROUND:MASK, e.g. 9:0x01 (default: no fault)')
+    parser.add_argument('--latency', type=float, default=0.001, help='Emulated time per command (s)')
+    parser.add_argument('--link-delay', dest='link_delay', type=float, default=0.002,
+                        help='Emulated delay of the serial link (s)')
+    config = parser.parse_args()
+
+    rcon = list(RCON)
+    if config.rcon_fault:
+        r, mask = config.rcon_fault.split(':')
+        rcon[int(r, 0)] ^= int(mask, 0)
+    emu = EmulatedTarget(rcon=rcon, latency=config.latency, link_delay=config.link_delay)
+    pipe = Pipeline(FdTransport(emu.master), depth=config.depth)
+
+    plts = [os.urandom(16) for _ in range(config.N)]
+    start = time.monotonic()
+    results = pipe.run('a', plts, 16)
+    elapsed = time.monotonic() - start
+
+    ref = AES(KEY, rcon=rcon)
+    good = sum(r['valid'] and r['payload'] == ref.encrypt(p) for r, p in zip(results, plts))
+    print(f"{good}/{config.N} ciphertexts correct in {elapsed:.2f} s (depth {config.depth})")
+    emu.close()
@@ -0,0 +1,201 @@
+"""Pipelined SimpleSerial 2.1 acquisition.
+
+Frames are written and read directly on the serial link: a response is parsed
+as soon as its terminating 0x00 arrives, each frame has its own timeout, and
+up to `depth` requests are in flight at once. With depth=1 this replaces the
+write / sleep(0.1) / read sequence of run.py; larger depths need a target
+that buffers its input (a PTY or an interrupt-driven UART): the stm32f3 HAL
+polls the UART and drops bytes received while it encrypts.
+
+Frame layout (simpleserial/simpleserial.c):
+    host -> target: [stuff, cmd, scmd, len, data..., crc, 0x00]
+    target -> host: [stuff, cmd, len, data..., crc, 0x00]
+Every command is answered by its 'r' frame(s) followed by an 'e' frame
+carrying the return value of the handler.
+"""
+import collections
+import os
+import select
+import time
+import tty
+
+CW_CRC = 0x4D
+FRAME_BYTE = 0x00
+
+
+def ss_crc(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ CW_CRC) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def stuff(body):
+    """Byte-stuff [0, body..., 0]: each zero of the frame points to the next one"""
+    buf = bytearray([0]) + bytearray(body) + bytearray([0])
+    last = 0
+    for i in range(1, len(buf)):
+        if buf[i] == FRAME_BYTE:
+            buf[last] = i - last
+            last = i
+    return bytes(buf)
+
+
+def unstuff(frame):
+    """Inverse of stuff() on a frame including its terminator; None if malformed"""
+    buf = bytearray(frame)
+    nxt = buf[0]
+    buf[0] = 0
+    while nxt < len(buf) - 1:
+        step = buf[nxt]
+        if step == 0:
+            return None
+        buf[nxt] = 0
+        nxt += step
+    if nxt != len(buf) - 1:
+        return None
+    return bytes(buf[1:-1])
+
+
+def encode_command(cmd, data, scmd=0):
+    body = bytes([ord(cmd), scmd, len(data)]) + bytes(data)
+    return stuff(body + bytes([ss_crc(body)]))
+
+
+def decode_response(frame):
+    """(cmd, payload) of a target frame, or None if it is corrupted"""
+    body = unstuff(frame)
+    if body is None or len(body) < 3 or body[1] != len(body) - 3:
+        return None
+    if ss_crc(body[:-1]) != body[-1]:
+        return None
+    return chr(body[0]), body[2:-1]
+
+
+class FdTransport:
+    """Serial link on a file descriptor, e.g. the master side of a PTY"""
+
+    def __init__(self, fd):
+        self.fd = fd
+
+    @classmethod
+    def open(cls, path):
+        """Raw serial link on a tty device, e.g. the PTY of hal/linux"""
+        fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(fd)
+        return cls(fd)
+
+    def close(self):
+        os.close(self.fd)
+
+    def write(self, data):
+        view = memoryview(data)
+        while view:
+            n = os.write(self.fd, view)
+            view = view[n:]
+
+    def read(self, timeout):
+        """Whatever bytes are available within `timeout` seconds (b'' if none)"""
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return b''
+        return os.read(self.fd, 4096)
+
+
+class CWTransport:
+    """Serial link of a ChipWhisperer SimpleSerial2 target (target.ser)"""
+
+    def __init__(self, target):
+        self.ser = target.ser
+
+    def write(self, data):
+        self.ser.write(bytes(data))
+
+    def read(self, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            n = self.ser.inWaiting()
+            if n:
+                return bytes(self.ser.read(n, 0))
+            if time.monotonic() >= deadline:
+                return b''
+            time.sleep(0.0002)
+
+
+class Pipeline:
+    """Keeps up to `depth` commands in flight on `transport`.
+
+    `timeout` bounds the wait for each frame, in seconds. A response that does
+    not arrive in time or fails its CRC invalidates every command in flight,
+    since later frames can no longer be matched to their requests.
+    """
+
+    def __init__(self, transport, depth=1, timeout=0.05):
+        self.transport = transport
+        self.depth = depth
+        self.timeout = timeout
+        self.rxbuf = bytearray()
+
+    def _next_frame(self, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            end = self.rxbuf.find(FRAME_BYTE)
+            if end >= 0:
+                frame = bytes(self.rxbuf[:end + 1])
+                del self.rxbuf[:end + 1]
+                return frame
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.rxbuf += self.transport.read(left)
+
+    def flush(self, quiet=0.01):
+        """Drop input until the link has been silent for `quiet` seconds"""
+        self.rxbuf.clear()
+        while self.transport.read(quiet):
+            pass
+
+    def run(self, cmd, payloads, rlen, timeout=None):
+        """Send `cmd` with each payload and return one result per payload, in
+        order: a dict like simpleserial_read_witherrors() with 'valid',
+        'payload' (the rlen bytes of the 'r' frame) and 'rv' (handler return)."""
+        timeout = self.timeout if timeout is None else timeout
+        results = []
+        pending = collections.deque()
+        payloads = iter(payloads)
+        exhausted = False
+
+        while True:
+            while not exhausted and len(pending) < self.depth:
+                data = next(payloads, None)
+                if data is None:
+                    exhausted = True
+                    break
+                self.transport.write(encode_command(cmd, data))
+                pending.append({'valid': False, 'payload': None, 'rv': None})
+            if not pending:
+                return results
+
+            frame = self._next_frame(timeout)
+            resp = decode_response(frame) if frame is not None else None
+            if resp is None:
+                # lost or corrupted frame: give up on everything in flight
+                results.extend(pending)
+                pending.clear()
+                self.flush()
+                continue
+
+            c, data = resp
+            head = pending[0]
+            if c == 'r' and len(data) == rlen and head['payload'] is None:
+                head['payload'] = data
+            elif c == 'e' and len(data) == 1:
+                head['rv'] = data[0]
+                head['valid'] = head['payload'] is not None and data[0] == 0
+                results.append(pending.popleft())
+            else:
+                results.extend(pending)
+                pending.clear()
+                self.flush()
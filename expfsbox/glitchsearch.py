@@ -0,0 +1,159 @@
+"""Adaptive glitch-parameter search.
+
+Drop-in replacement of the GlitchController.glitch_values() loop of run.py:
+the same ranges and steps define a grid, but instead of walking it in order
+each trial goes to the cell chosen by Thompson sampling. Every cell has a Beta
+posterior on its reward (`REWARD`: 1 for a success, 0 for a reset or a normal
+run) built from the trials of the cell and, with smaller weights, of its
+neighbours, so a success also raises the cells around it. Until something is
+found the search spreads over the grid, favouring the least tried regions;
+afterwards it concentrates around the successes.
+
+Trials are appended to a JSONL file and replayed on start, so an interrupted
+campaign resumes where it stopped:
+
+    search = GlitchSearch({"width": (1.6, 3.6, 0.4), ...}, log="trials.jsonl")
+    for width, offset, ext_offset in search.glitch_values(max_trials=2000):
+        ...
+        search.add("success" / "reset" / "normal")
+
+`python3 glitchsearch.py` compares it with the grid walk on a simulated target.
+"""
+import argparse
+import json
+import os
+
+import numpy as np
+
+REWARD = {"success": 1.0, "reset": 0.0, "normal": 0.0}
+# weight of the trials of a cell at grid distance 0, 1, 2 along each axis
+KERNEL = np.array([0.25, 0.5, 1.0, 0.5, 0.25])
+
+
+class GlitchSearch:
+
+    def __init__(self, ranges, log=None, seed=None, reward=REWARD):
+        """`ranges` maps each parameter, in the order of the yielded tuples,
+        to (start, stop, step) as given to gc.set_range()/gc.set_step()"""
+        self.names = list(ranges)
+        self.axes = [np.round(np.arange(a, b + step / 2, step), 6) for a, b, step in ranges.values()]
+        shape = tuple(len(ax) for ax in self.axes)
+        self.trials = np.zeros(shape)
+        self.rewards = np.zeros(shape)
+        self.successes = []
+        self.reward = reward
+        self.rng = np.random.default_rng(seed)
+        # prior mean of one success in the grid, with the weight of 2 trials
+        p0 = 1.0 / self.trials.size
+        self.prior = (2 * p0, 2 * (1 - p0))
+        self.log = log
+        self.current = None
+        if log is not None and os.path.exists(log):
+            with open(log) as f:
+                for line in f:
+                    if line.strip():
+                        trial = json.loads(line)
+                        self._record(tuple(trial[n] for n in self.names), trial["outcome"])
+
+    def _index(self, setting):
+        return tuple(int(np.argmin(np.abs(ax - v))) for ax, v in zip(self.axes, setting))
+
+    def _record(self, setting, outcome):
+        idx = self._index(setting)
+        self.trials[idx] += 1
+        self.rewards[idx] += self.reward[outcome]
+        if outcome == "success":
+            self.successes.append(setting)
+
+    def _smooth(self, counts):
+        """Kernel-weighted sum of the counts of each cell and its neighbours"""
+        out = counts
+        for axis in range(counts.ndim):
+            pad = [(0, 0)] * counts.ndim
+            pad[axis] = (2, 2)
+            padded = np.pad(out, pad)
+            n = out.shape[axis]
+            out = sum(w * np.take(padded, np.arange(k, k + n), axis=axis) for k, w in enumerate(KERNEL))
+        return out
+
+    def next_setting(self):
+        trials = self._smooth(self.trials)
+        rewards = self._smooth(self.rewards)
+        sample = self.rng.beta(self.prior[0] + rewards, self.prior[1] + trials - rewards)
+        idx = np.unravel_index(np.argmax(sample), sample.shape)
+        return tuple(float(ax[i]) for ax, i in zip(self.axes, idx))
+
+    def glitch_values(self, max_trials=None):
+        """Yields the next setting until max_trials trials (resumed ones included)"""
+        while max_trials is None or self.trials.sum() < max_trials:
+            self.current = self.next_setting()
+            yield self.current
+
+    def add(self, outcome):
+        """Outcome ("success", "reset" or "normal") of the last yielded setting"""
+        self._record(self.current, outcome)
+        if self.log is not None:
+            trial = dict(zip(self.names, self.current))
+            trial["outcome"] = outcome
+            with open(self.log, "a") as f:
+                f.write(json.dumps(trial) + "\n")
+
+
+class SimulatedTarget:
+    """Stochastic outcomes: a success peak around `center` (with probability
+    `peak`), resets growing with the width and near the peak, normal otherwise"""
+
+    def __init__(self, center, scale, peak=0.2, rng=None):
+        self.center = np.array(center)
+        self.scale = np.array(scale)
+        self.peak = peak
+        self.rng = rng if rng is not None else np.random.default_rng()
+
+    def glitch(self, setting):
+        d2 = (((np.array(setting) - self.center) / self.scale) ** 2).sum()
+        p_success = self.peak * np.exp(-d2 / 2)
+        p_reset = min(1 - p_success, 1 / (1 + np.exp(-4 * (setting[0] - 3.2))) + 0.5 * np.exp(-d2 / 8))
+        u = self.rng.random()
+        if u < p_success:
+            return "success"
+        return "reset" if u < p_success + p_reset else "normal"
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--runs', type=int, default=20, help='Simulated campaigns per strategy')
+    parser.add_argument('--successes', type=int, default=5, help='Successes to collect per campaign')
+    parser.add_argument('--seed', type=int, default=1)
+    config = parser.parse_args()
+
+    # ranges of expfsbox/run.py
+    ranges = {"width": (1.6, 3.6, 0.4), "offset": (-4, -2, 0.4), "ext_offset": (0, 100, 1)}
+    rng = np.random.default_rng(config.seed)
+
+    cost = {"grid": [], "adaptive": []}
+    for run in range(config.runs):
+        center = (rng.uniform(1.6, 3.2), rng.uniform(-4, -2), rng.uniform(0, 100))
+        for strategy in cost:
+            target = SimulatedTarget(center, (0.3, 0.4, 1.5), rng=np.random.default_rng(rng.integers(1 << 32)))
+            search = GlitchSearch(ranges, seed=int(rng.integers(1 << 32)))
+            if strategy == "grid":
+                # gc.glitch_values() order, repeated until done
+                grid = [tuple(float(v) for v in s) for s in
+                        np.stack(np.meshgrid(*search.axes, indexing="ij"), -1).reshape(-1, 3)]
+                settings = (grid[i % len(grid)] for i in range(50 * len(grid)))
+            else:
+                settings = search.glitch_values(50 * search.trials.size)
+            found = n = 0
+            for n, setting in enumerate(settings, 1):
+                outcome = target.glitch(setting)
+                if strategy == "adaptive":
+                    search.add(outcome)
+                found += outcome == "success"
+                if found == config.successes:
+                    break
+            cost[strategy].append(n)
+
+    for strategy, trials in cost.items():
+        print(f"{strategy:8s}: trials to {config.successes} successes: "
+              f"median {np.median(trials):7.0f}, mean {np.mean(trials):7.0f}")
@@ -0,0 +1,152 @@
+/*
+    Host-native HAL, see linux_hal.h
+*/
+
+#define _GNU_SOURCE     // posix_openpt(), ptsname(), cfmakeraw()
+
+#include "hal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static int pty_master = -1;
+static int pty_slave = -1;
+
+static unsigned char rxbuf[4096];
+static size_t rxlen, rxpos;
+static unsigned char txbuf[4096];
+static size_t txlen;
+
+static int fault_location = -1;
+static int trigger_windows;
+static int in_window;
+static struct timespec trigger_start;
+static FILE *trigger_log;
+
+static void flush_tx(void)
+{
+    size_t off = 0;
+
+    while (off < txlen) {
+        ssize_t n = write(pty_master, txbuf + off, txlen - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("hal/linux: write");
+            exit(1);
+        }
+        off += (size_t) n;
+    }
+    txlen = 0;
+}
+
+void platform_init(void)
+{
+    const char *env;
+
+    if ((env = getenv("HAL_FAULT_LOCATION")) != NULL) {
+        fault_location = (int) strtol(env, NULL, 0);
+    }
+    if ((env = getenv("HAL_TRIGGER_LOG")) != NULL) {
+        trigger_log = fopen(env, "w");
+        if (trigger_log == NULL) {
+            perror("hal/linux: trigger log");
+            exit(1);
+        }
+    }
+}
+
+void init_uart(void)
+{
+    struct termios tio;
+    const char *link, *name;
+
+    pty_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_master < 0 || grantpt(pty_master) != 0 || unlockpt(pty_master) != 0
+            || (name = ptsname(pty_master)) == NULL) {
+        perror("hal/linux: PTY");
+        exit(1);
+    }
+
+    // keep the slave open so that reads block while no host is connected
+    pty_slave = open(name, O_RDWR | O_NOCTTY);
+    if (pty_slave < 0 || tcgetattr(pty_slave, &tio) != 0) {
+        perror("hal/linux: PTY slave");
+        exit(1);
+    }
+    cfmakeraw(&tio);
+    tcsetattr(pty_slave, TCSANOW, &tio);
+
+    if ((link = getenv("HAL_PTY_LINK")) != NULL) {
+        unlink(link);
+        if (symlink(name, link) != 0) {
+            perror("hal/linux: PTY link");
+            exit(1);
+        }
+    }
+    fprintf(stderr, "hal/linux: serial port %s\n", link != NULL ? link : name);
+}
+
+void putch(char c)
+{
+    if (txlen == sizeof(txbuf)) {
+        flush_tx();
+    }
+    txbuf[txlen++] = (unsigned char) c;
+}
+
+char getch(void)
+{
+    if (rxpos == rxlen) {
+        // a command is answered before the next one is read
+        flush_tx();
+        for (;;) {
+            ssize_t n = read(pty_master, rxbuf, sizeof(rxbuf));
+            if (n > 0) {
+                rxlen = (size_t) n;
+                rxpos = 0;
+                break;
+            }
+            if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                perror("hal/linux: read");
+                exit(1);
+            }
+        }
+    }
+    return (char) rxbuf[rxpos++];
+}
+
+void trigger_setup(void)
+{
+}
+
+void trigger_high(void)
+{
+    in_window = 1;
+    clock_gettime(CLOCK_MONOTONIC, &trigger_start);
+}
+
+void trigger_low(void)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    in_window = 0;
+    trigger_windows++;
+    if (trigger_log != NULL) {
+        fprintf(trigger_log, "%lld\n",
+                (long long) (end.tv_sec - trigger_start.tv_sec) * 1000000000LL
+                + (end.tv_nsec - trigger_start.tv_nsec));
+        fflush(trigger_log);
+    }
+}
+
+int linux_fault_hit(int index)
+{
+    // the glitch hits the first trigger window, i.e. the table generation
+    return in_window && trigger_windows == 0 && index == fault_location;
+}
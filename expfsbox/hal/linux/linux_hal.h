@@ -0,0 +1,31 @@
+/*
+    Host-native HAL: the firmware runs as a Linux process and talks
+    SimpleSerial over a pseudo-terminal.
+
+    Environment variables read by platform_init():
+      HAL_PTY_LINK        symlink created to the slave side of the PTY
+                          (the path is also printed on stderr)
+      HAL_FAULT_LOCATION  index at which HAL_FAULT_SKIP() skips the faulted
+                          statement, inside the first trigger window only
+                          (default: -1, no fault)
+      HAL_TRIGGER_LOG     file receiving the duration of each trigger
+                          window, in ns
+*/
+
+#ifndef LINUX_HAL_H
+#define LINUX_HAL_H
+
+#include <stdint.h>
+
+void init_uart(void);
+void putch(char c);
+char getch(void);
+
+void trigger_setup(void);
+void trigger_low(void);
+void trigger_high(void);
+
+int linux_fault_hit(int index);
+#define HAL_FAULT_SKIP(i, stmt) do { if (!linux_fault_hit(i)) { stmt; } } while (0)
+
+#endif // LINUX_HAL_H
@@ -1,5 +1,6 @@
 import numpy as np
 import argparse
+import itertools
 
 
 S = [
@@ -30,6 +31,38 @@ RCON = [
     0xD4, 0xB3, 0x7D, 0xFA, 0xEF, 0xC5, 0x91, 0x39,
 ]
 
+# Offset of ciphertext byte j in the flattened 16x256 counter
+OFFSETS = (np.arange(16) * 256).astype(np.uint16)
+
+def count_bytes(cpts):
+    """16x256 occurrence counts of the bytes of an (N,16) uint8 array of ciphertexts"""
+    cpts = np.asarray(cpts, dtype=np.uint8).reshape(-1, 16)
+    return np.bincount((cpts + OFFSETS).ravel(), minlength=16*256).reshape(16, 256)
+
+
+def count_chunks(chunks):
+    """count_bytes() accumulated over an iterable of ciphertext chunks"""
+    counter = np.zeros((16,256), dtype=np.int64)
+    for cpts in chunks:
+        counter += count_bytes(cpts)
+    return counter
+
+
+def iter_ciphertexts(path, chunk_size):
+    """
+    Ciphertexts of a hex text file as successive (<=chunk_size,16) uint8 arrays,
+    so that arbitrarily large captures are processed in bounded memory; a
+    chunk_size of 0 gives the whole file as one array.
+    """
+    with open(path, "r") as f:
+        while True:
+            lines = [l.strip() for l in itertools.islice(f, chunk_size if chunk_size > 0 else None)]
+            lines = [l for l in lines if l]
+            if not lines:
+                return
+            yield np.frombuffer(bytes.fromhex("".join(lines)), dtype=np.uint8).reshape(-1, 16)
+
+
 def getfaultedSbox(i, f):
     FS = S[:]
     FS[i] ^= f
@@ -105,20 +138,17 @@ if __name__ == "__main__":
                         default='5b12a47f2b5571191ec06d7c02fc6076',
                         help='Reference master key')
 
+    parser.add_argument('--chunk-size', dest='chunk_size',
+                        type=int,
+                        default=1 << 20,
+                        help='Ciphertexts parsed and counted at once, to bound memory (0: all at once)')
+
     config = parser.parse_args()
 
-    with open(config.path_to_file, "r") as f: cpts = f.readlines()
-    cpts = [bytes.fromhex(c.strip()) for c in cpts]
-    N = len(cpts)
+    counter = count_chunks(iter_ciphertexts(config.path_to_file, config.chunk_size))
+    N = int(counter[0].sum())
     print(f"There are {N} ciphertexts")
 
-    counter = np.zeros((16,256), dtype=np.uint32)
-
-    for i in range(N):
-        n = i+1
-        for j in range(16):
-            counter[j][cpts[i][j]] += 1
-
     cmin = np.zeros(16, dtype=np.uint8)
     cmax = np.zeros(16, dtype=np.uint8)
     fcount = np.zeros(256, dtype=np.uint8)
@@ -0,0 +1,86 @@
+"""simpleserial-glitch built for hal/linux, as a local stand-in target.
+
+    cd simpleserial-glitch && make PLATFORM=LINUX && cd ..
+    python3 linuxtarget.py --location 0x49 -n 3000 --depth 8
+
+starts the firmware process, checks its 'a' ciphertexts and 'b' summaries
+against the reference AES of ssemu.py and reports the throughput.
+"""
+import argparse
+import os
+import struct
+import subprocess
+import tempfile
+import time
+
+import numpy as np
+
+from acquisition import FdTransport, Pipeline
+from keyrecovery import S, count_bytes
+from ssemu import AES, KEY, prng_block, skipped_sbox
+
+# FIRMWARE overrides the path of the executable
+FIRMWARE = os.environ.get("FIRMWARE") or os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "simpleserial-glitch", "simpleserial-glitch-LINUX.elf")
+
+
+class LinuxTarget:
+    """Firmware process with its PTY opened as `self.transport`"""
+
+    def __init__(self, firmware=FIRMWARE, location=-1):
+        self.tmp = tempfile.TemporaryDirectory()
+        link = os.path.join(self.tmp.name, "tty")
+        env = dict(os.environ, HAL_PTY_LINK=link, HAL_FAULT_LOCATION=str(location),
+                   HAL_TRIGGER_LOG=os.path.join(self.tmp.name, "trigger"))
+        self.proc = subprocess.Popen([firmware], env=env, stderr=subprocess.DEVNULL)
+        while not os.path.exists(link):
+            if self.proc.poll() is not None:
+                raise RuntimeError(f"{firmware} exited with {self.proc.returncode}")
+            time.sleep(0.01)
+        self.transport = FdTransport.open(link)
+
+    def trigger_windows(self):
+        """Durations of the trigger windows so far, in ns"""
+        with open(os.path.join(self.tmp.name, "trigger")) as f:
+            return [int(line) for line in f if line.strip()]
+
+    def close(self):
+        self.transport.close()
+        self.proc.kill()
+        self.proc.wait()
+        self.tmp.cleanup()
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-n', dest='N', type=int, default=3000, help='Number of ciphertexts')
+    parser.add_argument('--depth', type=int, default=8, help='Requests in flight')
+    parser.add_argument('--location', type=lambda x: int(x, 0), default=0x49,
+                        help='Faulted S-box index (-1: no fault)')
+    parser.add_argument('--seed', type=int, default=1, help='Seed of the b command')
+    config = parser.parse_args()
+
+    target = LinuxTarget(location=config.location)
+    pipe = Pipeline(target.transport, depth=config.depth)
+    pipe.flush()
+    ref = AES(KEY, skipped_sbox(config.location) if config.location >= 0 else S)
+
+    plts = [os.urandom(16) for _ in range(config.N)]
+    start = time.monotonic()
+    results = pipe.run('a', plts, 16)
+    elapsed = time.monotonic() - start
+    good = sum(r['valid'] and r['payload'] == ref.encrypt(p) for r, p in zip(results, plts))
+    print(f"a: {good}/{config.N} ciphertexts correct, {config.N / elapsed:.0f} commands/s (depth {config.depth})")
+
+    start = time.monotonic()
+    summary = pipe.run('b', [struct.pack('<QIB', config.seed, config.N, 1)], 52, timeout=10)[0]
+    elapsed = time.monotonic() - start
+    counter = count_bytes(np.frombuffer(b''.join(ref.encrypt(prng_block(config.seed, i))
+                                                 for i in range(config.N)), dtype=np.uint8))
+    expected = (bytes(np.argmin(counter, 1).astype(np.uint8)) + bytes(np.argmax(counter, 1).astype(np.uint8))
+                + bytes(np.minimum((counter == 0).sum(1), 255).astype(np.uint8)) + struct.pack('<I', config.N))
+    print(f"b: summary {'matches' if summary['payload'] == expected else 'DIFFERS'}, "
+          f"{config.N / elapsed:.0f} encryptions/s")
+    print(f"trigger windows (ns): {target.trigger_windows()}")
+    target.close()
@@ -1,5 +1,9 @@
 from matplotlib import pyplot as plt
+from acquisition import Pipeline, CWTransport
+from glitchsearch import GlitchSearch
+from sprt import FaultSPRT
 import chipwhisperer as cw
+import struct
 import time
 import os
 import numpy as np
@@ -12,43 +16,108 @@ def reboot_flush(scope, target):
     #Flush garbage too
     target.flush()
 
-def check_good_fault(N=3000, threshold=5):
-    cpts = np.zeros((N,16), np.uint8)
-    for i in range(N):
-        print(f"Encrypting for checking good fault: {i:4d}")
-        plt = bytearray(os.urandom(16))
-        target.simpleserial_write('a', plt)
-        time.sleep(0.1)
-        response = target.simpleserial_read_witherrors('r', 16, glitch_timeout=10, timeout=50)
-        if response['valid'] is False:
-            gc.add('reset')
-        else:
-            cpt = list(bytes(response['payload']))
-            cpts[i] = cpt
-
-    counter = np.zeros((16,256), dtype=np.uint32)
-    for i in range(N):
-        for j in range(16):
-            counter[j][cpts[i][j]] += 1
+def request_summary(seed, N, clear=True):
+    """Encrypt N generated plaintexts on the target with the 'b' command.
+    Returns (cmin, cmax, zeros, n) computed on-device, or None on error."""
+    target.simpleserial_write('b', struct.pack('<QIB', seed, N, 1 if clear else 0))
+    # about 1 ms per encryption on the STM32F3 at 7.37 MHz, with a 4x margin
+    response = target.simpleserial_read_witherrors('r', 52, glitch_timeout=10, timeout=500 + 4 * N)
+    if response['valid'] is False:
+        return None
+    payload = bytes(response['payload'])
+    cmin = np.frombuffer(payload[0:16], dtype=np.uint8)
+    cmax = np.frombuffer(payload[16:32], dtype=np.uint8)
+    zeros = np.frombuffer(payload[32:48], dtype=np.uint8)
+    n, = struct.unpack('<I', payload[48:52])
+    return cmin, cmax, zeros, n
+
+
+def collect_ciphertexts(N):
+    """Ciphertexts of N random plaintexts as an (n,16) array of the valid
+    responses only, and the number of responses that were invalid or lost"""
+    plts = [os.urandom(16) for _ in range(N)]
+    results = Pipeline(CWTransport(target)).run('a', plts, 16)
+    cpts = [list(response['payload']) for response in results if response['valid']]
+    return np.array(cpts, dtype=np.uint8).reshape(-1, 16), N - len(cpts)
+
+
+def write_ciphertexts(cpts, path="cpts.txt"):
+    f = open(path, "w")
+    for cpt in cpts:
+        f.write(bytes(list(cpt)).hex().zfill(32) + "\n")
+    f.close()
+
+
+def check_good_fault(N=3000, threshold=5, chunk=64):
+    """Sequential test of sprt.py on the ciphertexts, stopped as soon as it
+    decides; after N ciphertexts without a decision, the f-vote threshold
+    decides as before. A good fault is topped up to N ciphertexts in cpts.txt."""
+    test = FaultSPRT()
+    batches = []
+    resets = 0
+    while test.decision is None and test.n < N:
+        cpts, lost = collect_ciphertexts(min(chunk, N - test.n))
+        resets += lost
+        if len(cpts) == 0:
+            print(f"No valid response in a chunk ({resets} lost so far)")
+            return False
+        batches.append(cpts)
+        test.update(cpts)
+        print(f"{test.n:4d} ciphertexts: log LR = {test.llr:8.2f}, P(fault) = {test.confidence():.6f}")
+
+    decision = test.decision
+    if decision is None:
+        f_counter = np.bincount(np.argmin(test.counter, 1) ^ np.argmax(test.counter, 1), minlength=256)
+        print(f"Undecided, the same fault appears at {np.max(f_counter)} ciphertext bytes!")
+        decision = bool(np.max(f_counter) >= threshold)
+    print(f"{'Fault' if decision else 'No fault'} after {test.n} ciphertexts "
+          f"(P(fault) = {test.confidence():.6f}, f = {test.fault_value()}, {resets} responses lost)")
+
+    if decision:
+        n = test.n
+        while n < N:
+            cpts, lost = collect_ciphertexts(N - n)
+            resets += lost
+            if len(cpts) == 0:
+                break
+            batches.append(cpts)
+            n += len(cpts)
+        write_ciphertexts(np.concatenate(batches))
+    if resets:
+        gc.add('reset')
+    return decision
+
+
+def check_good_fault_summary(N=3000, threshold=5, seed=None):
+    """Fault check on the summary computed by the target ('b' command): one
+    round-trip for the N encryptions, but no early stopping. Needs firmware
+    rebuilt with 'b'; the glitch loop decides with check_good_fault()."""
+    if seed is None:
+        seed = int.from_bytes(os.urandom(8), 'little')
+    summary = request_summary(seed, N)
+    if summary is None:
+        gc.add('reset')
+        return False
+    cmin, cmax, zeros, n = summary
+    print(f"Summary of {n} ciphertexts (seed {seed:#018x})")
+    if n != N:
+        # reset or partial batch on the target: the counters are not those of N
+        gc.add('reset')
+        return False
 
-    cmin = np.zeros(16, dtype=np.uint8)
-    cmax = np.zeros(16, dtype=np.uint8)
     f_counter = np.zeros(256, dtype=np.uint8)
 
     for j in range(16):
-        cmin[j] = np.argmin(counter[j])
-        cmax[j] = np.argmax(counter[j])
         f = cmin[j]^cmax[j]
         f_counter[f] += 1  
-        print(f"j = {j:2d}: (cmin, cmax) = ({cmin[j]:3d}, {cmax[j]:3d}), f = {cmin[j]^cmax[j]}")
+        print(f"j = {j:2d}: (cmin, cmax) = ({cmin[j]:3d}, {cmax[j]:3d}), f = {f}, unseen = {zeros[j]}")
 
     print(f"The same fault appears at {np.max(f_counter)} ciphertext bytes!")
     if np.max(f_counter) >= threshold:
-        f = open("cpts.txt", "w")
-        for i in range(N):
-            cpt = bytes(list(cpts[i])).hex().zfill(32)
-            f.write(cpt + "\n")
-        f.close()
+        cpts, lost = collect_ciphertexts(N)
+        if lost:
+            print(f"{lost} responses lost, {len(cpts)} ciphertexts kept")
+        write_ciphertexts(cpts)
         return True
     else:
         return False
@@ -87,6 +156,8 @@ if __name__ == "__main__":
     gc.set_range("ext_offset", 0, 100)
     gc.set_global_step(0.4)
     gc.set_step("ext_offset", 1)
+    # same grid, visited adaptively; trials.jsonl lets an interrupted run resume
+    search = GlitchSearch({"width": (1.6, 3.6, 0.4), "offset": (-4, -2, 0.4), "ext_offset": (0, 100, 1)}, log="trials.jsonl")
     scope.glitch.repeat = 1
 
     reboot_flush(scope, target)
@@ -97,7 +168,7 @@ if __name__ == "__main__":
     is_sbox_faulted = False    
 
     # BEGIN GLITCH
-    for glitch_setting in gc.glitch_values():
+    for glitch_setting in search.glitch_values(max_trials=20000):
         print(f"O = {glitch_setting[1]}, W = {glitch_setting[0]}, E = {glitch_setting[2]}")
         scope.glitch.offset = glitch_setting[1]
         scope.glitch.width = glitch_setting[0]
@@ -116,19 +187,23 @@ if __name__ == "__main__":
         if ret:
             print("[RESET] Timeout, no trigger!")
             gc.add("reset")
+            search.add("reset")
             reboot_flush(scope, target)
         else:
             response = target.simpleserial_read_witherrors('r', 16, glitch_timeout=10, timeout=50)
             if response['valid'] is False:
                 gc.add('reset')
+                search.add("reset")
                 reboot_flush(scope, target)
             else:
                 is_good_fault = check_good_fault()
                 if is_good_fault:
+                    search.add("success")
                     print("Good fault")
                     break
                 else:
                     print("Fault is not good. Try a different fault!")
+                    search.add("normal")
                     gc.add("reset")
                     reboot_flush(scope, target)
             
@@ -0,0 +1,44 @@
+/*
+ * On-target byte histograms of the ciphertexts, see pfasummary.h
+ */
+
+#include "pfasummary.h"
+#include <string.h>
+
+void pfa_summary_clear(struct pfa_summary *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void pfa_summary_update(struct pfa_summary *s, const uint8_t cpt[16])
+{
+    for (int j = 0; j < 16; j++) {
+        uint16_t *c = &s->counter[j][cpt[j]];
+
+        if (*c != 0xFFFF) {
+            (*c)++;
+        }
+    }
+    s->n++;
+}
+
+void pfa_summary_pack(const struct pfa_summary *s, uint8_t out[PFA_SUMMARY_REPLY_LEN])
+{
+    for (int j = 0; j < 16; j++) {
+        const uint16_t *c = s->counter[j];
+        int cmin = 0, cmax = 0, zeros = 0;
+
+        for (int v = 0; v < 256; v++) {
+            if (c[v] < c[cmin]) cmin = v;
+            if (c[v] > c[cmax]) cmax = v;
+            if (c[v] == 0) zeros++;
+        }
+        out[j]      = (uint8_t) cmin;
+        out[16 + j] = (uint8_t) cmax;
+        out[32 + j] = (uint8_t) (zeros > 255 ? 255 : zeros);
+    }
+    out[48] = (uint8_t) (s->n);
+    out[49] = (uint8_t) (s->n >> 8);
+    out[50] = (uint8_t) (s->n >> 16);
+    out[51] = (uint8_t) (s->n >> 24);
+}
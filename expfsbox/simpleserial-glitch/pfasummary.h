@@ -0,0 +1,39 @@
+/**
+ * \file pfasummary.h
+ *
+ * \brief On-target byte histograms of the ciphertexts
+ *
+ * The 'b' command encrypts a batch of generated plaintexts on the target and
+ * only counts the ciphertext bytes, so checking a glitch costs one serial
+ * round-trip instead of one per ciphertext. The reply summarizes each byte
+ * by the c_min/c_max of keyrecovery.py and the number of values not seen.
+ * This file has no HAL dependency and builds on the host as well.
+ */
+
+#ifndef PFASUMMARY_H
+#define PFASUMMARY_H
+
+#include <stdint.h>
+
+#define PFA_SUMMARY_REQ_LEN   13  // seed (8), count (4), flags (1), little-endian
+#define PFA_SUMMARY_REPLY_LEN 52  // cmin[16], cmax[16], zeros[16], n (4)
+
+#define PFA_SUMMARY_CLEAR     0x01  // flag: restart the counters and the block index
+
+struct pfa_summary {
+    uint16_t counter[16][256];  // saturating occurrence counts
+    uint32_t n;                 // ciphertexts counted since the last clear
+};
+
+void pfa_summary_clear(struct pfa_summary *s);
+
+void pfa_summary_update(struct pfa_summary *s, const uint8_t cpt[16]);
+
+/*
+ * Reply of the 'b' command: per byte, the first least and the first most
+ * frequent value (np.argmin/np.argmax of the counters), the number of values
+ * that never occurred (capped at 255), then n
+ */
+void pfa_summary_pack(const struct pfa_summary *s, uint8_t out[PFA_SUMMARY_REPLY_LEN]);
+
+#endif /* PFASUMMARY_H */
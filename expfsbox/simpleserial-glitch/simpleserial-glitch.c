@@ -29,6 +29,8 @@
 #include <time.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "prng.h"
+#include "pfasummary.h"
 
 /*
  * Forward S-box & tables
@@ -102,7 +104,7 @@ MBEDTLS_MAYBE_UNUSED static void aes_gen_tables(void)
         x ^= y; y = (y << 1) | (y >> 7);
         x ^= y; y = (y << 1) | (y >> 7);
         x ^= y; y = (y << 1) | (y >> 7);
-        x ^= y ^ 0x63;
+        HAL_FAULT_SKIP(i, x ^= y ^ 0x63);
 
         FSb[i] = x;
 #if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
@@ -660,6 +662,47 @@ uint8_t fault_and_encrypt(uint8_t cmd, uint8_t scmd, uint8_t len, uint8_t* indat
     return 0;
 }
 
+/*
+ * Encrypt a batch of generated plaintexts and reply with the byte summary
+ * (see pfasummary.h). Successive calls with the same seed continue the
+ * block index, which restarts when PFA_SUMMARY_CLEAR is set.
+ */
+static struct pfa_summary summary;
+
+uint8_t encrypt_summary(uint8_t cmd, uint8_t scmd, uint8_t len, uint8_t* indata){
+
+    if (aes_ctx_done == 0){
+        mbedtls_aes_init(&ctx);
+        mbedtls_aes_setkey_enc(&ctx, key, 128);
+        aes_ctx_done = 1;        
+    }
+
+    int ret = 0, mode=MBEDTLS_AES_ENCRYPT;
+    unsigned char buf[16];
+    uint8_t reply[PFA_SUMMARY_REPLY_LEN];
+    uint64_t seed = 0;
+    uint32_t count = 0;
+
+    for (int i = 7; i >= 0; i--) seed = (seed << 8) | indata[i];
+    for (int i = 11; i >= 8; i--) count = (count << 8) | indata[i];
+    if (indata[12] & PFA_SUMMARY_CLEAR) {
+        pfa_summary_clear(&summary);
+    }
+
+    for (uint32_t i = 0; i < count; i++){
+        prng_block(seed, summary.n, buf);
+        ret = mbedtls_aes_crypt_ecb(&ctx, mode, buf, buf);
+        if (ret != 0) {
+            return ret;
+        }
+        pfa_summary_update(&summary, buf);
+    }
+
+    pfa_summary_pack(&summary, reply);
+    simpleserial_put('r', PFA_SUMMARY_REPLY_LEN, reply);
+    return 0;
+}
+
 int main(void)
 {
     platform_init();
@@ -680,6 +723,7 @@ int main(void)
 
     simpleserial_init();
     simpleserial_addcmd('a', 16, fault_and_encrypt);  
+    simpleserial_addcmd('b', PFA_SUMMARY_REQ_LEN, encrypt_summary);
 
     while(1)
         simpleserial_get();
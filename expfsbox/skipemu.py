@@ -0,0 +1,802 @@
+"""Instruction-skip emulator for the compiled firmware.
+
+Loads simpleserial-glitch-CWLITEARM.elf, emulates aes_gen_tables() with a
+small Thumb-2 interpreter (only the instructions the compiler emitted there)
+and runs it once up to trigger_high(). The state at every instruction of the
+trigger window is kept as a snapshot of the golden run; each trial restores
+the snapshot of its first skipped instruction, skips `width` consecutive
+instructions and runs to the end of the window. As soon as the registers are
+back to those of the golden run at the same step, and the corrupted memory is
+not read again in the window, the rest of the window is known to be identical
+and the trial stops there.
+
+The tables at the end of the window are compared with the golden run and the
+skip is classified:
+
+    none      no difference
+    sbox-1    one FSb entry differs (the persistent fault of the attack)
+    sbox-n    several FSb entries differ
+    rcon      round_constants differ
+    context   only registers differ when the window ends
+    hang      the window did not end within the step budget
+    crash     invalid memory access or instruction not emulated
+
+    python3 skipemu.py --width 1,2 -o skips.csv
+"""
+import argparse
+import csv
+import os
+import re
+import struct
+import time
+
+# Firmware of the experiment folder it is run from (expfsbox or expfrcon)
+FIRMWARE = os.path.join("simpleserial-glitch", "simpleserial-glitch-CWLITEARM.elf")
+RAM_BASE, RAM_SIZE = 0x20000000, 0xA000      # STM32F303xC SRAM
+RETURN = 0xFFFFFFFE                          # lr of the emulated call
+
+
+class EmulationError(Exception):
+    pass
+
+
+# ----------------------------------------------------------------------------
+# ELF
+# ----------------------------------------------------------------------------
+
+def load_elf(path):
+    """(segments [(vaddr, bytes)], symbols {name: (value, size)})"""
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise ValueError(f"{path}: not a 32-bit little-endian ELF")
+    (phoff, shoff) = struct.unpack_from("<II", elf, 0x1C)
+    (phentsize, phnum, shentsize, shnum) = struct.unpack_from("<HHHH", elf, 0x2A)
+
+    segments = []
+    for i in range(phnum):
+        p_type, p_offset, p_vaddr, p_paddr, p_filesz, p_memsz = \
+            struct.unpack_from("<IIIIII", elf, phoff + i * phentsize)
+        if p_type == 1:     # PT_LOAD, .bss included as zeros
+            data = elf[p_offset:p_offset + p_filesz] + bytes(p_memsz - p_filesz)
+            segments.append((p_vaddr, data))
+
+    sections = [struct.unpack_from("<IIIIIIIIII", elf, shoff + i * shentsize) for i in range(shnum)]
+    symbols = {}
+    for sh in sections:
+        if sh[1] != 2:      # SHT_SYMTAB
+            continue
+        strtab = sections[sh[6]]
+        for off in range(sh[4], sh[4] + sh[5], 16):
+            st_name, st_value, st_size = struct.unpack_from("<III", elf, off)
+            end = elf.index(b"\x00", strtab[4] + st_name)
+            name = elf[strtab[4] + st_name:end].decode()
+            if name:
+                symbols.setdefault(name, (st_value, st_size))
+    return segments, symbols
+
+
+def load_listing(path):
+    """{address: 'mnemonic operands'} from the .lss of the firmware, if present"""
+    listing = {}
+    if os.path.exists(path):
+        pattern = re.compile(r"^\s*([0-9a-f]+):\t[0-9a-f ]+\t(.*)$")
+        with open(path, errors="replace") as f:
+            for line in f:
+                m = pattern.match(line)
+                if m:
+                    listing[int(m.group(1), 16)] = " ".join(m.group(2).split(";")[0].split())
+    return listing
+
+
+# ----------------------------------------------------------------------------
+# Memory and CPU state
+# ----------------------------------------------------------------------------
+
+class Memory:
+    """Flash and RAM of the ELF; RAM writes and reads can be logged"""
+
+    def __init__(self, segments):
+        self.flash = []
+        self.ram = bytearray(RAM_SIZE)
+        for vaddr, data in segments:
+            if RAM_BASE <= vaddr < RAM_BASE + RAM_SIZE:
+                self.ram[vaddr - RAM_BASE:vaddr - RAM_BASE + len(data)] = data
+            else:
+                self.flash.append((vaddr, data))
+        self.reads = None
+        self.writes = None
+
+    def read(self, addr, size):
+        off = addr - RAM_BASE
+        if 0 <= off <= RAM_SIZE - size:
+            if self.reads is not None:
+                self.reads.extend(range(addr, addr + size))
+            return int.from_bytes(self.ram[off:off + size], "little")
+        for base, data in self.flash:
+            if base <= addr and addr + size <= base + len(data):
+                return int.from_bytes(data[addr - base:addr - base + size], "little")
+        raise EmulationError(f"read of {size} bytes at {addr:#010x}")
+
+    def write(self, addr, size, value):
+        off = addr - RAM_BASE
+        if not 0 <= off <= RAM_SIZE - size:
+            raise EmulationError(f"write of {size} bytes at {addr:#010x}")
+        self.ram[off:off + size] = (value & ((1 << (8 * size)) - 1)).to_bytes(size, "little")
+        if self.writes is not None:
+            self.writes.extend(range(addr, addr + size))
+
+
+class CPU:
+    __slots__ = ("r", "n", "z", "c", "v", "it", "mem")
+
+    def __init__(self, mem):
+        self.r = [0] * 16
+        self.n = self.z = self.c = self.v = 0
+        self.it = 0
+        self.mem = mem
+
+    def state(self):
+        return tuple(self.r) + (self.n, self.z, self.c, self.v, self.it)
+
+    def restore(self, state):
+        self.r = list(state[:16])
+        self.n, self.z, self.c, self.v, self.it = state[16:]
+
+    def cond(self, cond):
+        n, z, c, v = self.n, self.z, self.c, self.v
+        base = cond >> 1
+        if base == 0: r = z
+        elif base == 1: r = c
+        elif base == 2: r = n
+        elif base == 3: r = v
+        elif base == 4: r = c and not z
+        elif base == 5: r = n == v
+        elif base == 6: r = (not z) and n == v
+        else: return True
+        return bool(r) != bool(cond & 1)
+
+
+M32 = 0xFFFFFFFF
+
+
+def sext(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def add_with_carry(cpu, a, b, carry, setflags):
+    result = a + b + carry
+    r = result & M32
+    if setflags:
+        cpu.n = r >> 31
+        cpu.z = int(r == 0)
+        cpu.c = int(result > M32)
+        cpu.v = int(((a ^ r) & (b ^ r)) >> 31 & 1)
+    return r
+
+
+def set_nz(cpu, r):
+    cpu.n = r >> 31
+    cpu.z = int(r == 0)
+
+
+def shift_c(cpu, value, stype, amount):
+    """(result, carry) of an immediate shift (DecodeImmShift + Shift_C)"""
+    c = cpu.c
+    if stype == 0:
+        if amount == 0:
+            return value, c
+        return (value << amount) & M32, (value >> (32 - amount)) & 1
+    if stype == 1:
+        amount = amount or 32
+        return (value >> amount) if amount < 32 else 0, (value >> (amount - 1)) & 1
+    if stype == 2:
+        amount = amount or 32
+        s = sext(value, 32) >> min(amount, 31)
+        return s & M32, (sext(value, 32) >> (amount - 1)) & 1
+    if amount == 0:         # RRX
+        return (c << 31) | (value >> 1), value & 1
+    r = ((value >> amount) | (value << (32 - amount))) & M32
+    return r, r >> 31
+
+
+def expand_imm_c(cpu, imm12):
+    if imm12 >> 10 == 0:
+        imm8 = imm12 & 0xFF
+        kind = (imm12 >> 8) & 3
+        value = (imm8, imm8 * 0x00010001, imm8 * 0x01000100, imm8 * 0x01010101)[kind]
+        return value, cpu.c
+    unrot = 0x80 | (imm12 & 0x7F)
+    rot = imm12 >> 7
+    r = ((unrot >> rot) | (unrot << (32 - rot))) & M32
+    return r, r >> 31
+
+
+# ----------------------------------------------------------------------------
+# Thumb-2 decoder: each instruction becomes a closure on the CPU
+# ----------------------------------------------------------------------------
+
+def decode(mem, pc):
+    """(size, execute) where execute(cpu) returns the branch target, if taken"""
+    hw1 = mem.read(pc, 2)
+    if hw1 >> 11 in (0b11101, 0b11110, 0b11111):
+        hw2 = mem.read(pc + 2, 2)
+        return 4, decode32(hw1, hw2, pc)
+    return 2, decode16(hw1, pc)
+
+
+def decode16(hw, pc):
+    def in_it(cpu):
+        return cpu.it & 0xF != 0
+
+    if hw >> 11 == 0b00100:                     # MOVS Rd, #imm8
+        d, imm = (hw >> 8) & 7, hw & 0xFF
+        def f(cpu):
+            cpu.r[d] = imm
+            if not in_it(cpu):
+                set_nz(cpu, imm)
+        return f
+    if hw >> 11 == 0b00101:                     # CMP Rn, #imm8
+        n, imm = (hw >> 8) & 7, hw & 0xFF
+        def f(cpu):
+            add_with_carry(cpu, cpu.r[n], ~imm & M32, 1, True)
+        return f
+    if hw >> 11 == 0b00110:                     # ADDS Rdn, #imm8
+        d, imm = (hw >> 8) & 7, hw & 0xFF
+        def f(cpu):
+            cpu.r[d] = add_with_carry(cpu, cpu.r[d], imm, 0, not in_it(cpu))
+        return f
+    if hw >> 11 == 0b00111:                     # SUBS Rdn, #imm8
+        d, imm = (hw >> 8) & 7, hw & 0xFF
+        def f(cpu):
+            cpu.r[d] = add_with_carry(cpu, cpu.r[d], ~imm & M32, 1, not in_it(cpu))
+        return f
+    if hw >> 13 == 0 and (hw >> 11) & 3 != 3:   # LSLS/LSRS/ASRS Rd, Rm, #imm5
+        stype, imm, m, d = (hw >> 11) & 3, (hw >> 6) & 0x1F, (hw >> 3) & 7, hw & 7
+        def f(cpu):
+            r, c = shift_c(cpu, cpu.r[m], stype, imm)
+            cpu.r[d] = r
+            if not in_it(cpu):
+                set_nz(cpu, r)
+                cpu.c = c
+        return f
+    if hw >> 10 == 0b010000:                    # data processing, registers
+        op, m, d = (hw >> 6) & 0xF, (hw >> 3) & 7, hw & 7
+        if op in (0, 1, 12, 14, 15, 8):         # ANDS EORS ORRS BICS MVNS TST
+            def f(cpu):
+                a, b = cpu.r[d], cpu.r[m]
+                r = (a & b if op in (0, 8) else a ^ b if op == 1 else a | b if op == 12
+                     else a & ~b & M32 if op == 14 else ~b & M32)
+                if op != 8:
+                    cpu.r[d] = r
+                if op == 8 or not in_it(cpu):
+                    set_nz(cpu, r)
+            return f
+        if op == 10:                            # CMP Rn, Rm
+            def f(cpu):
+                add_with_carry(cpu, cpu.r[d], ~cpu.r[m] & M32, 1, True)
+            return f
+    if hw >> 8 == 0b01000110:                   # MOV Rd, Rm (high registers)
+        d, m = ((hw >> 4) & 8) | (hw & 7), (hw >> 3) & 0xF
+        def f(cpu):
+            cpu.r[d] = (pc + 4) if m == 15 else cpu.r[m]
+            if d == 15:
+                return cpu.r[15] & ~1
+        return f
+    if hw >> 7 == 0b010001110:                  # BX Rm
+        m = (hw >> 3) & 0xF
+        def f(cpu):
+            return cpu.r[m] & ~1
+        return f
+    if hw >> 11 == 0b01001:                     # LDR Rt, [PC, #imm]
+        t, addr = (hw >> 8) & 7, ((pc + 4) & ~3) + (hw & 0xFF) * 4
+        def f(cpu):
+            cpu.r[t] = cpu.mem.read(addr, 4)
+        return f
+    if hw >> 12 == 0b0101:                      # LDR/STR (register offset)
+        op, m, n, t = (hw >> 9) & 7, (hw >> 6) & 7, (hw >> 3) & 7, hw & 7
+        size = (4, 2, 1, 1, 4, 2, 1, 2)[op]
+        if op in (0, 1, 2):
+            def f(cpu):
+                cpu.mem.write((cpu.r[n] + cpu.r[m]) & M32, size, cpu.r[t])
+            return f
+        if op in (4, 5, 6):
+            def f(cpu):
+                cpu.r[t] = cpu.mem.read((cpu.r[n] + cpu.r[m]) & M32, size)
+            return f
+    if hw >> 13 == 0b011:                       # LDR/STR(B) Rt, [Rn, #imm5]
+        b, load, imm, n, t = (hw >> 12) & 1, (hw >> 11) & 1, (hw >> 6) & 0x1F, (hw >> 3) & 7, hw & 7
+        size = 1 if b else 4
+        def f(cpu):
+            addr = (cpu.r[n] + imm * size) & M32
+            if load:
+                cpu.r[t] = cpu.mem.read(addr, size)
+            else:
+                cpu.mem.write(addr, size, cpu.r[t])
+        return f
+    if hw >> 11 == 0b10101:                     # ADD Rd, SP, #imm8
+        d, imm = (hw >> 8) & 7, (hw & 0xFF) * 4
+        def f(cpu):
+            cpu.r[d] = (cpu.r[13] + imm) & M32
+        return f
+    if hw >> 7 == 0b101100000:                  # ADD SP, SP, #imm7
+        imm = (hw & 0x7F) * 4
+        def f(cpu):
+            cpu.r[13] = (cpu.r[13] + imm) & M32
+        return f
+    if hw >> 7 == 0b101100001:                  # SUB SP, SP, #imm7
+        imm = (hw & 0x7F) * 4
+        def f(cpu):
+            cpu.r[13] = (cpu.r[13] - imm) & M32
+        return f
+    if hw >> 8 == 0b10110010:                   # SXTH SXTB UXTH UXTB
+        op, m, d = (hw >> 6) & 3, (hw >> 3) & 7, hw & 7
+        def f(cpu):
+            v = cpu.r[m]
+            cpu.r[d] = (sext(v & 0xFFFF, 16) & M32, sext(v & 0xFF, 8) & M32, v & 0xFFFF, v & 0xFF)[op]
+        return f
+    if hw >> 9 == 0b1011010:                    # PUSH {rlist, lr}
+        regs = [i for i in range(8) if hw >> i & 1] + ([14] if hw >> 8 & 1 else [])
+        def f(cpu):
+            sp = cpu.r[13] - 4 * len(regs)
+            for i, reg in enumerate(regs):
+                cpu.mem.write(sp + 4 * i, 4, cpu.r[reg])
+            cpu.r[13] = sp
+        return f
+    if hw >> 9 == 0b1011110:                    # POP {rlist, pc}
+        regs = [i for i in range(8) if hw >> i & 1] + ([15] if hw >> 8 & 1 else [])
+        def f(cpu):
+            sp = cpu.r[13]
+            for i, reg in enumerate(regs):
+                cpu.r[reg] = cpu.mem.read(sp + 4 * i, 4)
+            cpu.r[13] = sp + 4 * len(regs)
+            if 15 in regs:
+                return cpu.r[15] & ~1
+        return f
+    if hw >> 8 == 0b10111111 and hw & 0xF:      # IT
+        itstate = hw & 0xFF
+        def f(cpu):
+            cpu.it = itstate
+        f.sets_it = True
+        return f
+    if hw == 0xBF00:                            # NOP
+        return lambda cpu: None
+    if hw >> 12 == 0b1101 and (hw >> 8) & 0xF < 14:     # B<cond>
+        cond, target = (hw >> 8) & 0xF, pc + 4 + sext(hw & 0xFF, 8) * 2
+        def f(cpu):
+            if cpu.cond(cond):
+                return target
+        return f
+    if hw >> 11 == 0b11100:                     # B
+        target = pc + 4 + sext(hw & 0x7FF, 11) * 2
+        return lambda cpu: target
+    raise EmulationError(f"16-bit instruction {hw:04x} at {pc:#010x} not emulated")
+
+
+def decode32(hw1, hw2, pc):
+    # BL / B.W
+    if hw1 >> 11 == 0b11110 and hw2 >> 14 == 0b11 and (hw2 >> 12) & 1:
+        s = (hw1 >> 10) & 1
+        j1, j2 = (hw2 >> 13) & 1, (hw2 >> 11) & 1
+        i1, i2 = 1 - (j1 ^ s), 1 - (j2 ^ s)
+        imm = sext((s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3FF) << 12) | ((hw2 & 0x7FF) << 1), 25)
+        target = pc + 4 + imm
+        link = (hw2 >> 14) & 1
+        def f(cpu):
+            if link:
+                cpu.r[14] = (pc + 4) | 1
+            return target
+        f.target = target
+        return f
+    if hw1 >> 11 == 0b11110 and hw2 >> 14 == 0b10 and (hw2 >> 12) & 1 == 1:
+        s = (hw1 >> 10) & 1
+        j1, j2 = (hw2 >> 13) & 1, (hw2 >> 11) & 1
+        i1, i2 = 1 - (j1 ^ s), 1 - (j2 ^ s)
+        target = pc + 4 + sext((s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3FF) << 12)
+                               | ((hw2 & 0x7FF) << 1), 25)
+        return lambda cpu: target
+
+    # data processing (modified immediate)
+    if hw1 >> 11 == 0b11110 and (hw1 >> 9) & 1 == 0 and hw2 >> 15 == 0:
+        op, s, n = (hw1 >> 5) & 0xF, (hw1 >> 4) & 1, hw1 & 0xF
+        d = (hw2 >> 8) & 0xF
+        imm12 = ((hw1 >> 10) & 1) << 11 | ((hw2 >> 12) & 7) << 8 | (hw2 & 0xFF)
+        return data_processing(op, s, n, d, pc, lambda cpu: expand_imm_c(cpu, imm12))
+
+    # plain binary immediate: SBFX / UBFX / ADDW / SUBW
+    if hw1 >> 11 == 0b11110 and (hw1 >> 8) & 3 == 0b11 and hw2 >> 15 == 0:
+        op, n = (hw1 >> 4) & 0x1F, hw1 & 0xF
+        d = (hw2 >> 8) & 0xF
+        lsb = ((hw2 >> 12) & 7) << 2 | (hw2 >> 6) & 3
+        width = (hw2 & 0x1F) + 1
+        if op in (0b10100, 0b11100):            # SBFX / UBFX
+            signed = op == 0b10100
+            def f(cpu):
+                v = (cpu.r[n] >> lsb) & ((1 << width) - 1)
+                cpu.r[d] = (sext(v, width) & M32) if signed else v
+            return f
+    if hw1 >> 11 == 0b11110 and (hw1 >> 8) & 3 == 0b10 and hw2 >> 15 == 0:
+        op, n = (hw1 >> 4) & 0x1F, hw1 & 0xF
+        d = (hw2 >> 8) & 0xF
+        imm = ((hw1 >> 10) & 1) << 11 | ((hw2 >> 12) & 7) << 8 | (hw2 & 0xFF)
+        if op in (0b00000, 0b01010):            # ADDW / SUBW
+            sign = 1 if op == 0 else -1
+            def f(cpu):
+                base = ((pc + 4) & ~3) if n == 15 else cpu.r[n]
+                cpu.r[d] = (base + sign * imm) & M32
+            return f
+        if op in (0b00100, 0b01100):            # MOVW / MOVT
+            imm16 = (n << 12) | imm
+            top = op == 0b01100
+            def f(cpu):
+                cpu.r[d] = ((cpu.r[d] & 0xFFFF) | (imm16 << 16)) if top else imm16
+            return f
+
+    # data processing (shifted register)
+    if hw1 >> 9 == 0b1110101:
+        op, s, n = (hw1 >> 5) & 0xF, (hw1 >> 4) & 1, hw1 & 0xF
+        d, m = (hw2 >> 8) & 0xF, hw2 & 0xF
+        stype, amount = (hw2 >> 4) & 3, ((hw2 >> 12) & 7) << 2 | (hw2 >> 6) & 3
+        return data_processing(op, s, n, d, pc, lambda cpu: shift_c(cpu, cpu.r[m], stype, amount))
+
+    # UXTB.W / SXTB.W
+    if hw1 >> 4 in (0xFA5, 0xFA4) and hw1 & 0xF == 0xF and hw2 >> 12 == 0xF and (hw2 >> 7) & 1:
+        signed = hw1 >> 4 == 0xFA4
+        d, m, rot = (hw2 >> 8) & 0xF, hw2 & 0xF, ((hw2 >> 4) & 3) * 8
+        def f(cpu):
+            v = ((cpu.r[m] >> rot) | (cpu.r[m] << (32 - rot))) & 0xFF if rot else cpu.r[m] & 0xFF
+            cpu.r[d] = (sext(v, 8) & M32) if signed else v
+        return f
+
+    # load / store single
+    if hw1 >> 9 == 0b1111100:
+        size = (1, 2, 4, 0)[(hw1 >> 5) & 3]
+        signed = (hw1 >> 8) & 1
+        load = (hw1 >> 4) & 1
+        n, t = hw1 & 0xF, (hw2 >> 12) & 0xF
+        if size and not signed and n != 15:
+            if (hw1 >> 7) & 1:                  # imm12
+                imm = hw2 & 0xFFF
+                def f(cpu):
+                    addr = (cpu.r[n] + imm) & M32
+                    if load:
+                        cpu.r[t] = cpu.mem.read(addr, size)
+                    else:
+                        cpu.mem.write(addr, size, cpu.r[t])
+                return f
+            if (hw2 >> 11) & 1:                 # imm8, pre/post-indexed
+                p, u, w, imm = (hw2 >> 10) & 1, (hw2 >> 9) & 1, (hw2 >> 8) & 1, hw2 & 0xFF
+                off = imm if u else -imm
+                def f(cpu):
+                    base = cpu.r[n]
+                    addr = (base + off) & M32 if p else base
+                    if load:
+                        cpu.r[t] = cpu.mem.read(addr, size)
+                    else:
+                        cpu.mem.write(addr, size, cpu.r[t])
+                    if w:
+                        cpu.r[n] = (base + off) & M32
+                return f
+            if (hw2 >> 6) & 0x3F == 0:          # register, LSL #imm2
+                m, sh = hw2 & 0xF, (hw2 >> 4) & 3
+                def f(cpu):
+                    addr = (cpu.r[n] + (cpu.r[m] << sh)) & M32
+                    if load:
+                        cpu.r[t] = cpu.mem.read(addr, size)
+                    else:
+                        cpu.mem.write(addr, size, cpu.r[t])
+                return f
+        if size == 4 and load and n == 15:      # LDR.W Rt, [PC, #imm12]
+            u = (hw1 >> 7) & 1
+            addr = ((pc + 4) & ~3) + ((hw2 & 0xFFF) if u else -(hw2 & 0xFFF))
+            def f(cpu):
+                cpu.r[t] = cpu.mem.read(addr, 4)
+            return f
+    raise EmulationError(f"32-bit instruction {hw1:04x} {hw2:04x} at {pc:#010x} not emulated")
+
+
+def data_processing(op, s, n, d, pc, operand_c):
+    """Shared by the immediate and shifted-register forms"""
+    if op in (0, 1, 2, 3, 4):                   # AND BIC ORR ORN EOR (TST TEQ MOV MVN)
+        def f(cpu):
+            b, c = operand_c(cpu)
+            a = 0 if (op in (2, 3) and n == 15) else cpu.r[n]
+            r = (a & b, a & ~b, a | b, a | (~b & M32), a ^ b)[op] & M32
+            if not (d == 15 and s):             # TST / TEQ only set flags
+                cpu.r[d] = r
+            if s:
+                set_nz(cpu, r)
+                cpu.c = c
+        return f
+    if op in (8, 10, 11, 13, 14):               # ADD ADC SBC SUB RSB (CMN CMP)
+        def f(cpu):
+            b, _ = operand_c(cpu)
+            a = cpu.r[n]
+            if op == 8:
+                r = add_with_carry(cpu, a, b, 0, s)
+            elif op == 10:
+                r = add_with_carry(cpu, a, b, cpu.c, s)
+            elif op == 11:
+                r = add_with_carry(cpu, a, ~b & M32, cpu.c, s)
+            elif op == 13:
+                r = add_with_carry(cpu, a, ~b & M32, 1, s)
+            else:
+                r = add_with_carry(cpu, ~a & M32, b, 1, s)
+            if not (d == 15 and s):
+                cpu.r[d] = r
+        return f
+    raise EmulationError(f"data processing op {op} at {pc:#010x} not emulated")
+
+
+# ----------------------------------------------------------------------------
+# Emulator
+# ----------------------------------------------------------------------------
+
+CHECKPOINT = 64     # window steps between two RAM snapshots of the golden run
+
+
+class Emulator:
+
+    def __init__(self, path=FIRMWARE, function="aes_gen_tables"):
+        segments, self.symbols = load_elf(path)
+        self.mem = Memory(segments)
+        self.cpu = CPU(self.mem)
+        self.cache = {}
+        self.entry = self.symbols[function][0] & ~1
+        self.hooks = (self.symbols["trigger_high"][0] & ~1, self.symbols["trigger_low"][0] & ~1)
+        self.tables = {name: self.symbols[name] for name in ("FSb", "round_constants")}
+        self.listing = load_listing(os.path.splitext(path)[0] + ".lss")
+
+    def fetch(self, pc):
+        ins = self.cache.get(pc)
+        if ins is None:
+            size, f = decode(self.mem, pc)
+            ins = self.cache[pc] = (size, f, getattr(f, "target", None), getattr(f, "sets_it", False))
+        return ins
+
+    def step(self, skip=False):
+        """Executes (or skips) the instruction at pc; returns the trigger hook
+        it calls, if any. A skipped instruction still consumes its IT slot."""
+        cpu = self.cpu
+        pc = cpu.r[15]
+        size, f, target, sets_it = self.fetch(pc)
+        it = cpu.it
+        in_block = it & 0xF and not sets_it
+        hook = nxt = None
+        if not skip and (not in_block or cpu.cond(it >> 4)):
+            if target in self.hooks:
+                # trigger_high() / trigger_low() only toggle a GPIO: not emulated
+                hook = target
+            else:
+                nxt = f(cpu)
+        if in_block:
+            cpu.it = 0 if it & 7 == 0 else (it & 0xE0) | ((it << 1) & 0x1F)
+        cpu.r[15] = pc + size if nxt is None else nxt
+        return hook
+
+    def golden(self, max_steps=1 << 20):
+        """Runs to trigger_high(), then records the window up to trigger_low():
+        the state before each step, the RAM bytes it writes, the last step
+        reading each address and a RAM snapshot every CHECKPOINT steps; then
+        runs to the return of the function to find the bytes it overwrites.
+        Returns the number of instructions in the window."""
+        cpu, mem = self.cpu, self.mem
+        cpu.r = [0] * 16
+        cpu.r[13] = RAM_BASE + RAM_SIZE
+        cpu.r[14] = RETURN
+        cpu.r[15] = self.entry
+        for _ in range(max_steps):
+            if self.step() == self.hooks[0]:
+                break
+        else:
+            raise EmulationError("trigger_high() not reached")
+
+        self.states, self.writes, self.checkpoints = [], [], {}
+        self.last_read = {}
+        for t in range(max_steps):
+            if t % CHECKPOINT == 0:
+                self.checkpoints[t] = bytes(mem.ram)
+            self.states.append(cpu.state())
+            mem.reads, mem.writes = [], []
+            hook = self.step()
+            for a in mem.reads:
+                self.last_read[a] = t
+            self.writes.append([(a, mem.ram[a - RAM_BASE]) for a in mem.writes])
+            if hook == self.hooks[1]:
+                break
+        else:
+            raise EmulationError("trigger_low() not reached")
+        self.end_pc = cpu.r[15]
+        self.end_state = cpu.state()
+        self.end_ram = bytes(mem.ram)
+
+        # bytes the rest of the function overwrites before reading them: a
+        # difference there at the end of the window does not survive
+        first = {}
+        for _ in range(max_steps):
+            if cpu.r[15] == RETURN & ~1:
+                break
+            mem.reads, mem.writes = [], []
+            self.step()
+            for a in mem.reads:
+                first.setdefault(a, False)
+            for a in mem.writes:
+                first.setdefault(a, True)
+        else:
+            raise EmulationError("no return from the function")
+        mem.reads = mem.writes = None
+        self.healed = []
+        for a in sorted(a for a, written in first.items() if written):
+            off = a - RAM_BASE
+            if self.healed and self.healed[-1][1] == off:
+                self.healed[-1][1] = off + 1
+            else:
+                self.healed.append([off, off + 1])
+        self.last_write = {a: t for t, w in enumerate(self.writes) for a, _ in w}
+        return len(self.states)
+
+    def table(self, name, ram=None):
+        addr, size = self.tables[name]
+        off = addr - RAM_BASE
+        return bytes((self.end_ram if ram is None else ram)[off:off + size])
+
+    def trial(self, k, width=1, budget=None, converge=True):
+        """Skips window steps k .. k+width-1 and returns (class, detail)"""
+        cpu, mem = self.cpu, self.mem
+        n = len(self.states)
+        budget = 4 * n + 1000 if budget is None else budget
+        c = k - k % CHECKPOINT
+        mem.ram[:] = self.checkpoints[c]
+        cpu.restore(self.states[c])
+        mem.writes = written = []
+        t = c
+        wait = -1       # no convergence check before this step
+        try:
+            while t < k + width:
+                self.step(skip=t >= k)
+                t += 1
+            while cpu.r[15] != self.end_pc:
+                if t - k > budget:
+                    return "hang", ""
+                if converge and wait < t < n and cpu.r[15] == self.states[t][15] \
+                        and cpu.state() == self.states[t]:
+                    ram, wait = self._converged(c, t, written)
+                    if ram is not None:
+                        return self.classify(ram, self.end_state)
+                self.step()
+                t += 1
+        except EmulationError as e:
+            return "crash", str(e)
+        finally:
+            mem.writes = None
+        return self.classify(mem.ram, cpu.state())
+
+    def _converged(self, c, t, written):
+        """Registers equal the golden run at step t: if no differing byte is
+        read again, (end RAM of the trial, None), else (None, last read step)"""
+        golden = {}
+        for w in self.writes[c:t]:
+            golden.update(w)
+        ram = bytearray(self.end_ram)
+        wait = -1
+        for a in set(written).union(golden):
+            off = a - RAM_BASE
+            value = golden.get(a, self.checkpoints[c][off])
+            if self.mem.ram[off] != value:
+                wait = max(wait, self.last_read.get(a, -1))
+                if self.last_write.get(a, -1) < t:
+                    ram[off] = self.mem.ram[off]
+        if wait >= t:
+            return None, wait
+        return ram, None
+
+    def classify(self, ram, state):
+        ram = bytearray(ram)
+        for start, end in self.healed:
+            ram[start:end] = self.end_ram[start:end]
+        fsb, rcon = self.table("FSb", ram), self.table("round_constants", ram)
+        fsb0, rcon0 = self.table("FSb"), self.table("round_constants")
+        if rcon != rcon0:
+            words = [w for w in range(len(rcon) // 4) if rcon[4 * w:4 * w + 4] != rcon0[4 * w:4 * w + 4]]
+            return "rcon", " ".join(f"rcon[{w}]={int.from_bytes(rcon[4 * w:4 * w + 4], 'little'):#x}"
+                                    for w in words)
+        entries = [i for i in range(len(fsb)) if fsb[i] != fsb0[i]]
+        if entries:
+            detail = " ".join(f"S[{i:#04x}]^{fsb[i] ^ fsb0[i]:#04x}" for i in entries[:8])
+            return ("sbox-1" if len(entries) == 1 else "sbox-n"), detail
+        regs = [f"r{i}" for i in range(16) if state[i] != self.end_state[i]]
+        if regs:
+            return "context", " ".join(regs)
+        if ram != self.end_ram:
+            return "context", "memory"
+        return "none", ""
+
+    def describe(self, t):
+        """Address and disassembly of window step t"""
+        pc = self.states[t][15]
+        return pc, self.listing.get(pc, "")
+
+
+# ----------------------------------------------------------------------------
+# C-level reference: the skips modelled by hal/linux and faultingsbox/main.c
+# ----------------------------------------------------------------------------
+
+def gf_inv(a):
+    r = 0
+    for v in range(1, 256):
+        p, x, y = 0, a, v
+        while y:
+            if y & 1:
+                p ^= x
+            x = ((x << 1) ^ 0x11B) if x & 0x80 else x << 1
+            y >>= 1
+        if p == 1:
+            r = v
+    return r
+
+
+def c_level_fault(i):
+    """FSb[i] ^ f with `x ^= y ^ 0x63` skipped: f = y ^ 0x63 where y is the
+    inverse of i rotated by 4, the last term of the affine map"""
+    inv = gf_inv(i)
+    return ((inv << 4) | (inv >> 4)) & 0xFF ^ 0x63
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--firmware', default=os.environ.get("FIRMWARE", FIRMWARE),
+                        help='simpleserial-glitch-CWLITEARM.elf (.lss next to it is used if present)')
+    parser.add_argument('--width', default="1", help='Consecutive instructions skipped, e.g. 1,2,3')
+    parser.add_argument('--no-converge', dest='converge', action='store_false',
+                        help='Run every trial to the end of the window')
+    parser.add_argument('--check', type=int, default=0,
+                        help='Rerun this many random trials without convergence and compare')
+    parser.add_argument('-o', dest='output', default=None, help='CSV of every trial')
+    config = parser.parse_args()
+
+    emu = Emulator(config.firmware)
+    start = time.perf_counter()
+    n = emu.golden()
+    print(f"window: {n} instructions, golden run in {time.perf_counter() - start:.2f} s")
+
+    rows = []
+    start = time.perf_counter()
+    for width in (int(w) for w in config.width.split(",")):
+        for k in range(n - width + 1):
+            cls, detail = emu.trial(k, width, converge=config.converge)
+            pc, text = emu.describe(k)
+            rows.append((width, k, pc, text, cls, detail))
+    elapsed = time.perf_counter() - start
+    print(f"{len(rows)} trials in {elapsed:.2f} s ({1e3 * elapsed / len(rows):.2f} ms/trial)")
+
+    if config.check:
+        import random
+        sample = random.Random(1).sample(rows, min(config.check, len(rows)))
+        bad = [r for r in sample if emu.trial(r[1], r[0], converge=False) != (r[4], r[5])]
+        print(f"check: {len(sample) - len(bad)}/{len(sample)} trials identical without convergence")
+
+    if config.output:
+        with open(config.output, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(["width", "step", "pc", "instruction", "class", "detail"])
+            writer.writerows((w, k, f"{pc:#x}", text, cls, detail) for w, k, pc, text, cls, detail in rows)
+
+    classes = ("none", "sbox-1", "sbox-n", "rcon", "context", "hang", "crash")
+    for width in sorted({r[0] for r in rows}):
+        counts = {c: sum(r[0] == width and r[4] == c for r in rows) for c in classes}
+        print(f"width {width}: " + ", ".join(f"{c} {v}" for c, v in counts.items() if v))
+
+    # faults per instruction, against the skip modelled at the C level
+    by_pc = {}
+    for width, k, pc, text, cls, detail in rows:
+        if width == 1 and cls in ("sbox-1", "rcon"):
+            by_pc.setdefault((pc, text, cls), []).append(detail)
+    for (pc, text, cls), details in sorted(by_pc.items()):
+        print(f"  {pc:#x} {text:32s} {cls:7s} x{len(details):3d}  e.g. {details[0]}")
+    fsb_faults = [r[5] for r in rows if r[0] == 1 and r[4] == "sbox-1"]
+    same = sum(c_level_fault(int(d[2:6], 16)) == int(d[8:12], 16) for d in fsb_faults)
+    rcon_zero = sum(r[0] == 1 and r[4] == "rcon" and r[5].endswith("=0x0") and " " not in r[5]
+                    for r in rows)
+    print(f"single skips giving the C-level fault: S-box {same}/{len(fsb_faults)}, "
+          f"one Rcon zeroed {rcon_zero}")
@@ -0,0 +1,119 @@
+"""Sequential test for a persistent S-box fault on streamed ciphertexts.
+
+A faulted S-box entry S'[i] = S[i] ^ f removes the value a_j = S[i] ^ k_j from
+ciphertext byte j and doubles a_j ^ f. For each byte, with counts c[v]:
+
+    H0 (no fault):  every value has probability 1/256
+    H1 (fault f):   p[a] = 0, p[a ^ f] = 2/256 for an unknown a
+
+Mixing H1 uniformly over a (per byte) and f (shared by the 16 bytes) gives the
+likelihood ratio
+
+    L = 1/255 * sum_f prod_j ( 1/256 * sum_{a: c_j[a] = 0} 2^(c_j[a ^ f]) )
+
+which is updated after every chunk and compared with Wald's bounds
+A = (1 - beta) / alpha and B = beta / (1 - alpha). Being a mixture of
+likelihood ratios, L is a martingale under H0, so the error rates hold at any
+stopping time.
+"""
+import argparse
+
+import numpy as np
+
+from keyrecovery import S, count_bytes
+
+LN2 = np.log(2.0)
+# XOR_TABLE[f, a] = a ^ f for f = 1..255
+XOR_TABLE = np.bitwise_xor.outer(np.arange(1, 256), np.arange(256))
+
+
+def logsumexp(x, axis=None):
+    top = np.max(x, axis=axis, keepdims=True)
+    if not np.all(np.isfinite(top)):
+        return -np.inf
+    return np.squeeze(top, axis=axis) + np.log(np.exp(x - top).sum(axis=axis))
+
+
+def log_likelihood_ratio(counter):
+    """Natural log of L for a 16x256 counter"""
+    counter = np.asarray(counter)
+    per_f = np.full(255, -16 * np.log(256))
+    for j in range(16):
+        # only the missing values a contribute, with 2^c_j[a ^ f]
+        missing = np.flatnonzero(counter[j] == 0)
+        if len(missing) == 0:
+            return -np.inf
+        per_f += logsumexp(counter[j][XOR_TABLE[:, missing]] * LN2, axis=1)
+    return logsumexp(per_f) - np.log(255)
+
+
+class FaultSPRT:
+    """Accumulates ciphertexts and decides between H0 and H1.
+
+    decision is None while testing, True for a persistent fault and False for
+    no fault. `alpha` bounds the probability of accepting a glitch that did
+    not fault the S-box, `beta` that of rejecting one that did.
+    """
+
+    def __init__(self, alpha=1e-4, beta=1e-3):
+        self.upper = np.log((1 - beta) / alpha)
+        self.lower = np.log(beta / (1 - alpha))
+        self.counter = np.zeros((16, 256), dtype=np.int64)
+        self.n = 0
+        self.llr = 0.0
+        self.decision = None
+
+    def update(self, cpts):
+        cpts = np.asarray(cpts, dtype=np.uint8).reshape(-1, 16)
+        self.counter += count_bytes(cpts)
+        self.n += len(cpts)
+        self.llr = log_likelihood_ratio(self.counter)
+        if self.llr >= self.upper:
+            self.decision = True
+        elif self.llr <= self.lower:
+            self.decision = False
+        return self.decision
+
+    def confidence(self):
+        """Posterior probability of a fault for even prior odds"""
+        if self.llr >= 0:
+            return 1 / (1 + np.exp(-self.llr))
+        return np.exp(self.llr) / (1 + np.exp(self.llr))
+
+    def fault_value(self):
+        """Majority c_min ^ c_max of the 16 bytes, as check_good_fault() prints"""
+        cmin = np.argmin(self.counter, axis=1)
+        cmax = np.argmax(self.counter, axis=1)
+        return int(np.bincount(cmin ^ cmax, minlength=256).argmax())
+
+
+if __name__ == "__main__":
+
+    # Offline check on a last-round model: c_j = S'[u_j] ^ k_j with u_j uniform
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--runs', type=int, default=200, help='Runs per hypothesis')
+    parser.add_argument('--chunk', type=int, default=64, help='Ciphertexts per update')
+    parser.add_argument('--max', dest='N', type=int, default=3000, help='Ciphertexts per run')
+    parser.add_argument('--seed', type=int, default=1)
+    config = parser.parse_args()
+
+    rng = np.random.default_rng(config.seed)
+    for faulted in (False, True):
+        stops, wrong, undecided = [], 0, 0
+        for _ in range(config.runs):
+            sbox = np.array(S, dtype=np.uint8)
+            if faulted:
+                i = rng.integers(256)
+                sbox[i] ^= rng.integers(1, 256)
+            key = rng.integers(0, 256, 16, dtype=np.uint8)
+            test = FaultSPRT()
+            while test.decision is None and test.n < config.N:
+                u = rng.integers(0, 256, (config.chunk, 16))
+                test.update(sbox[u] ^ key)
+            if test.decision is None:
+                undecided += 1
+            else:
+                stops.append(test.n)
+                wrong += test.decision != faulted
+        print(f"{'fault   ' if faulted else 'no fault'}: mean stop {np.mean(stops):7.1f}, "
+              f"max {max(stops):5d}, wrong {wrong}, undecided {undecided} / {config.runs}")
@@ -0,0 +1,197 @@
+"""Emulated simpleserial-glitch target on a pseudo-terminal.
+
+Serves the 'v', 'a' and 'b' commands of simpleserial-glitch.c over the slave
+side of a PTY, with an AES whose S-box and round constants can be faulted, so
+acquisition.py can be exercised without a ChipWhisperer:
+
+    python3 ssemu.py -n 3000 --depth 8 --location 0x49
+"""
+import argparse
+import os
+import struct
+import queue
+import threading
+import time
+import tty
+
+import numpy as np
+
+from acquisition import FRAME_BYTE, FdTransport, Pipeline, ss_crc, stuff, unstuff
+from keyrecovery import S, count_bytes
+
+RCON = [0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36]
+KEY = bytes.fromhex('5b12a47f2b5571191ec06d7c02fc6076')
+MASK64 = (1 << 64) - 1
+
+
+def prng_block(seed, index):
+    """Plaintext `index` of stream `seed`, as simpleserial-glitch/prng.h"""
+    out = b''
+    for ctr in (2 * index, 2 * index + 1):
+        z = (seed + (ctr + 1) * 0x9E3779B97F4A7C15) & MASK64
+        z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & MASK64
+        z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK64
+        out += (z ^ (z >> 31)).to_bytes(8, 'little')
+    return out
+
+
+def xtime(a):
+    return ((a << 1) ^ 0x1B) & 0xFF if a & 0x80 else a << 1
+
+
+def gf_mul(a, b):
+    r = 0
+    while b:
+        if b & 1:
+            r ^= a
+        a, b = xtime(a), b >> 1
+    return r
+
+
+def skipped_sbox(location):
+    """S-box generated with `x ^= y ^ 0x63` skipped at index `location`,
+    the default fault of the simulator (aes_sbox_entry() in faultingsbox/main.c)"""
+    sbox = list(S)
+    inv = next((v for v in range(256) if gf_mul(location, v) == 1), 0)
+    sbox[location] ^= (((inv << 4) | (inv >> 4)) & 0xFF) ^ 0x63
+    return sbox
+
+
+class AES:
+    """AES-128 encryption with the S-box and Rcon given as data"""
+
+    def __init__(self, key, sbox=S, rcon=RCON):
+        self.sbox = list(sbox)
+        w = list(key)
+        for r in range(10):
+            # SubWord(RotWord(last word)) ^ Rcon, then the running xor
+            t = [self.sbox[w[-3]] ^ rcon[r], self.sbox[w[-2]], self.sbox[w[-1]], self.sbox[w[-4]]]
+            for j in range(16):
+                w.append(w[-16] ^ (t[j] if j < 4 else w[-4]))
+        self.rk = [w[16 * r:16 * r + 16] for r in range(11)]
+
+    def encrypt(self, pt):
+        s = [p ^ k for p, k in zip(pt, self.rk[0])]
+        for r in range(1, 11):
+            s = [self.sbox[b] for b in s]
+            s = [s[(i + 4 * (i % 4)) % 16] for i in range(16)]     # ShiftRows
+            if r < 10:
+                m = []
+                for c in range(4):
+                    a = s[4 * c:4 * c + 4]
+                    x = a[0] ^ a[1] ^ a[2] ^ a[3]
+                    m += [a[i] ^ x ^ xtime(a[i] ^ a[(i + 1) % 4]) for i in range(4)]
+                s = m
+            s = [b ^ k for b, k in zip(s, self.rk[r])]
+        return bytes(s)
+
+
+class EmulatedTarget:
+    """simpleserial-glitch.c on the slave side of a PTY, served by a thread.
+
+    `latency` is added to every command to mimic the time of the target and
+    the replies reach the host `link_delay` seconds after they are sent, as
+    through the USB bridge of the ChipWhisperer.
+    """
+
+    def __init__(self, key=KEY, sbox=S, rcon=RCON, latency=0.0, link_delay=0.0):
+        self.aes = AES(key, sbox, rcon)
+        self.latency = latency
+        self.link_delay = link_delay
+        self.outbox = queue.Queue()
+        self.counter = np.zeros((16, 256), dtype=np.int64)
+        self.n = 0
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.master)
+        tty.setraw(self.slave)
+        self.thread = threading.Thread(target=self._serve, daemon=True)
+        self.thread.start()
+        self.writer = threading.Thread(target=self._deliver, daemon=True)
+        self.writer.start()
+
+    def _put(self, c, data):
+        body = bytes([ord(c), len(data)]) + bytes(data)
+        self.outbox.put((time.monotonic() + self.link_delay, stuff(body + bytes([ss_crc(body)]))))
+
+    def _deliver(self):
+        while True:
+            due, frame = self.outbox.get()
+            wait = due - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+            try:
+                os.write(self.slave, frame)
+            except OSError:
+                return
+
+    def _handle(self, cmd, data):
+        if self.latency:
+            time.sleep(self.latency)
+        if cmd == 'v':
+            self._put('r', bytes([3]))
+        elif cmd == 'a' and len(data) == 16:
+            self._put('r', self.aes.encrypt(data))
+        elif cmd == 'b' and len(data) == 13:
+            seed, count, flags = struct.unpack('<QIB', data)
+            if flags & 1:
+                self.counter[:] = 0
+                self.n = 0
+            cpts = [self.aes.encrypt(prng_block(seed, self.n + i)) for i in range(count)]
+            self.counter += count_bytes(np.frombuffer(b''.join(cpts), dtype=np.uint8))
+            self.n += count
+            zeros = np.minimum((self.counter == 0).sum(1), 255)
+            self._put('r', bytes(np.argmin(self.counter, 1).astype(np.uint8))
+                           + bytes(np.argmax(self.counter, 1).astype(np.uint8))
+                           + bytes(zeros.astype(np.uint8)) + struct.pack('<I', self.n))
+        else:
+            return 0x01     # SS_ERR_CMD
+        return 0
+
+    def _serve(self):
+        buf = bytearray()
+        while True:
+            try:
+                buf += os.read(self.slave, 4096)
+            except OSError:
+                return
+            while FRAME_BYTE in buf:
+                end = buf.index(FRAME_BYTE)
+                body = unstuff(bytes(buf[:end + 1]))
+                del buf[:end + 1]
+                if body is None or len(body) < 4 or body[2] != len(body) - 4 \
+                        or ss_crc(body[:-1]) != body[-1]:
+                    self._put('e', bytes([0x04]))   # SS_ERR_CRC
+                    continue
+                rv = self._handle(chr(body[0]), body[3:-1])
+                self._put('e', bytes([rv]))
+
+    def close(self):
+        os.close(self.master)
+        os.close(self.slave)
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-n', dest='N', type=int, default=3000, help='Number of ciphertexts')
+    parser.add_argument('--depth', type=int, default=8, help='Requests in flight')
+    parser.add_argument('--location', type=lambda x: int(x, 0), default=0x49,
+                        help='Faulted S-box index (-1: no fault)')
+    parser.add_argument('--latency', type=float, default=0.001, help='Emulated time per command (s)')
+    parser.add_argument('--link-delay', dest='link_delay', type=float, default=0.002,
+                        help='Emulated delay of the serial link (s)')
+    config = parser.parse_args()
+
+    sbox = skipped_sbox(config.location) if config.location >= 0 else S
+    emu = EmulatedTarget(sbox=sbox, latency=config.latency, link_delay=config.link_delay)
+    pipe = Pipeline(FdTransport(emu.master), depth=config.depth)
+
+    plts = [os.urandom(16) for _ in range(config.N)]
+    start = time.monotonic()
+    results = pipe.run('a', plts, 16)
+    elapsed = time.monotonic() - start
+
+    ref = AES(KEY, sbox)
+    good = sum(r['valid'] and r['payload'] == ref.encrypt(p) for r, p in zip(results, plts))
+    print(f"{good}/{config.N} ciphertexts correct in {elapsed:.2f} s (depth {config.depth})")
+    emu.close()
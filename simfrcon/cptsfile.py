@@ -0,0 +1,58 @@
+import numpy as np
+
+# Binary container written by faultingrcon/main when the output ends with .bin:
+# a 64-byte little-endian header followed by `count` raw 16-byte ciphertexts
+# (see faultingrcon/cptsfile.h).
+MAGIC = b"PFACPTS\x00"
+HEADER = np.dtype([
+    ("magic",          "S8"),
+    ("version",        "<u4"),
+    ("record_size",    "<u4"),
+    ("fault_model",    "<u4"),
+    ("fault_location", "<i4"),
+    ("key_id",         "<u4"),
+    ("reserved",       "<u4"),
+    ("seed",           "<u8"),
+    ("count",          "<u8"),
+    ("pad",            "V16"),
+])
+FAULT_MODELS = ["none", "rcon-skip"]     # enum fault_model of faultingrcon/main.c
+
+
+def read_header(path):
+    """Header of a binary container as a dict, or None for a hex text file"""
+    with open(path, "rb") as f: raw = f.read(HEADER.itemsize)
+    if len(raw) < HEADER.itemsize or not raw.startswith(MAGIC):
+        return None
+    hdr = np.frombuffer(raw, dtype=HEADER)[0]
+    return {name: hdr[name].item() for name in HEADER.names if name != "pad"}
+
+
+def load_ciphertexts(path):
+    """
+    Ciphertexts of `path` as an (N,16) uint8 array.
+
+    Binary containers are memory-mapped read-only, without copying the records.
+    Hex text files (one ciphertext per line) are parsed in one pass.
+    """
+    hdr = read_header(path)
+    if hdr is not None:
+        assert hdr["record_size"] == 16, f"Unsupported record size {hdr['record_size']}"
+        if hdr["count"] == 0:
+            return np.zeros((0, 16), dtype=np.uint8)
+        return np.memmap(path, dtype=np.uint8, mode="r",
+                         offset=HEADER.itemsize, shape=(hdr["count"], 16))
+
+    with open(path, "r") as f: text = "".join(f.read().split())
+    return np.frombuffer(bytes.fromhex(text), dtype=np.uint8).reshape(-1, 16)
+
+
+def describe(path):
+    """One-line summary of the container metadata, empty for text files"""
+    hdr = read_header(path)
+    if hdr is None:
+        return ""
+    model = hdr["fault_model"]
+    model = FAULT_MODELS[model] if model < len(FAULT_MODELS) else str(model)
+    return (f"fault model = {model}, fault location = {hdr['fault_location']}, "
+            f"key id = {hdr['key_id']}, seed = {hdr['seed']}")
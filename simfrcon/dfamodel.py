@@ -0,0 +1,326 @@
+"""Rcon-skip DFA for any skipped iteration and key length.
+
+The skipped store leaves round_constants[i] at zero. That differs from the
+correct value by Rcon[i] in byte 0 of the word it is added to. The
+differences are propagated symbolically through mbedtls_aes_setkey_enc()
+and through the rounds. A byte difference is an XOR of a constant and GF(2^8)
+multiples of unknowns:
+    dK<word>.<byte>   output difference of a key-schedule SubWord (fixed by the key)
+    dS<round>.<byte>  output difference of a state SubBytes (different per plaintext)
+
+At the input x of the last round, each byte difference is observed through
+the ciphertexts as
+    D_j = InvS[c[p] ^ k[p]] ^ InvS[c'[p] ^ k[p] ^ dk[p]],   p = ShiftRows(j)
+with k the last round key and dk its difference. The state unknowns are
+eliminated between bytes whose dS parts are proportional. Each remaining
+relation links a few key bytes and dK unknowns. The solver takes the
+relation with the fewest unknowns left, enumerates them on all the pairs,
+keeps a unique solution and repeats. A relation with several solutions is
+retried once other relations have fixed some of its unknowns. For the fault
+of faultingrcon (AES-128, iteration 7) this finds the ten stages of
+keyrecovery.py.
+
+    python3 dfamodel.py --batch            # every key length and iteration
+    python3 dfamodel.py -k 192 -i 6        # one combination
+"""
+import argparse
+import itertools
+import multiprocessing
+import os
+import time
+
+import numpy as np
+
+from keyrecovery import SBOX, INV_SBOX, RCON, xtime
+
+INV_S = np.array(INV_SBOX, dtype=np.uint8)
+
+
+def gmul(a, b):
+    r = 0
+    while b:
+        if b & 1:
+            r ^= a
+        a, b = xtime(a), b >> 1
+    return r
+
+
+GMUL = np.array([[gmul(a, b) for b in range(256)] for a in range(256)], dtype=np.uint8)
+GINV = [0] + [next(b for b in range(1, 256) if gmul(a, b) == 1) for a in range(1, 256)]
+
+
+# ----------------------------------------------------------------------------
+# Symbolic differences
+# ----------------------------------------------------------------------------
+
+class Expr:
+    """const ^ XOR of coef * var, with GF(2^8) coefficients"""
+    __slots__ = ("const", "terms")
+
+    def __init__(self, const=0, terms=()):
+        self.const = const
+        self.terms = dict(terms)
+
+    @classmethod
+    def var(cls, name):
+        return cls(0, {name: 1})
+
+    def __xor__(self, other):
+        terms = dict(self.terms)
+        for v, c in other.terms.items():
+            terms[v] = terms.get(v, 0) ^ c
+            if terms[v] == 0:
+                del terms[v]
+        return Expr(self.const ^ other.const, terms)
+
+    def scale(self, k):
+        if k == 0:
+            return Expr()
+        return Expr(gmul(self.const, k), {v: gmul(c, k) for v, c in self.terms.items()})
+
+    def is_zero(self):
+        return self.const == 0 and not self.terms
+
+    def split(self, prefix):
+        """(part on the unknowns starting with prefix, rest)"""
+        inside = {v: c for v, c in self.terms.items() if v.startswith(prefix)}
+        rest = {v: c for v, c in self.terms.items() if not v.startswith(prefix)}
+        return Expr(0, inside), Expr(self.const, rest)
+
+    def __repr__(self):
+        parts = [f"{c:#04x}*{v}" if c != 1 else v for v, c in sorted(self.terms.items())]
+        if self.const or not parts:
+            parts.insert(0, f"{self.const:#04x}")
+        return " ^ ".join(parts)
+
+
+def rounds(keybits):
+    return keybits // 32 + 6
+
+
+def key_schedule_differences(keybits, iteration):
+    """Round key differences (Nr+1 lists of 16 Expr) of the skipped store,
+    following FIPS-197 (the same words as mbedtls_aes_setkey_enc())"""
+    nk, nr = keybits // 32, rounds(keybits)
+    w = [[Expr() for _ in range(4)] for _ in range(nk)]
+    for n in range(nk, 4 * (nr + 1)):
+        t = list(w[n - 1])
+        if n % nk == 0 or (nk > 6 and n % nk == 4):
+            if n % nk == 0:
+                t = t[1:] + t[:1]
+            t = [Expr() if e.is_zero() else Expr.var(f"dK{n}.{b}") for b, e in enumerate(t)]
+            if n % nk == 0 and n // nk - 1 == iteration:
+                t[0] = t[0] ^ Expr(RCON[iteration])
+        w.append([a ^ b for a, b in zip(w[n - nk], t)])
+    return [sum((w[4 * r + c] for c in range(4)), []) for r in range(nr + 1)]
+
+
+def shift_rows(s):
+    return [s[4 * ((c + r) % 4) + r] for c in range(4) for r in range(4)]
+
+
+def mix_columns(s):
+    out = []
+    for c in range(4):
+        a = s[4 * c:4 * c + 4]
+        for r in range(4):
+            out.append(a[r].scale(2) ^ a[(r + 1) % 4].scale(3) ^ a[(r + 2) % 4] ^ a[(r + 3) % 4])
+    return out
+
+
+class Model:
+    """Differences of one (key length, iteration) and the relations they give"""
+
+    def __init__(self, keybits, iteration):
+        self.keybits, self.iteration = keybits, iteration
+        self.nr = rounds(keybits)
+        self.dk = key_schedule_differences(keybits, iteration)
+        self.first_round_key = next((r for r, k in enumerate(self.dk)
+                                     if not all(e.is_zero() for e in k)), None)
+        s = [Expr() for _ in range(16)]
+        for r in range(1, self.nr):
+            s = [Expr() if e.is_zero() else Expr.var(f"dS{r}.{j}") for j, e in enumerate(s)]
+            s = mix_columns(shift_rows(s))
+            s = [a ^ b for a, b in zip(s, self.dk[r])]
+        self.dx = s
+        # ciphertext byte of each byte of x
+        self.pos = [4 * ((j // 4 - j % 4) % 4) + j % 4 for j in range(16)]
+        self.relations = self._relations()
+
+    def _relations(self):
+        """(terms [(coef, j)], rhs Expr) with XOR coef * D_j == rhs"""
+        split = [e.split("dS") for e in self.dx]
+        relations = []
+        for j, (state, rest) in enumerate(split):
+            if not state.terms:
+                relations.append(([(1, j)], rest))
+        for j1, j2 in itertools.combinations(range(16), 2):
+            s1, r1 = split[j1]
+            s2, r2 = split[j2]
+            if not s1.terms or s1.terms.keys() != s2.terms.keys():
+                continue
+            v = next(iter(s1.terms))
+            mu = gmul(s1.terms[v], GINV[s2.terms[v]])
+            if all(gmul(c, mu) == s1.terms[u] for u, c in s2.terms.items()):
+                relations.append(([(1, j1), (mu, j2)], r1 ^ r2.scale(mu)))
+        return relations
+
+    def unknowns(self, relation):
+        terms, rhs = relation
+        names = set(rhs.terms)
+        for _, j in terms:
+            p = self.pos[j]
+            names.add(f"k{p}")
+            names.update(self.dk[self.nr][p].terms)
+        return names
+
+
+# ----------------------------------------------------------------------------
+# Solver
+# ----------------------------------------------------------------------------
+
+def evaluate(expr, values):
+    """Value of expr (array over the candidates) from the known / enumerated unknowns"""
+    out = np.uint8(expr.const)
+    for v, c in expr.terms.items():
+        out = out ^ GMUL[c][values[v]]
+    return out
+
+
+def solve(model, ccpts, fcpts, max_unknowns=2):
+    """Known unknowns after the greedy search: {name: value}, with k0..k15 for
+    the bytes of the last round key. Returns (values, stages, status) where
+    stages lists the unknowns fixed by each relation used."""
+    ccpts = np.asarray(ccpts, dtype=np.uint8)
+    fcpts = np.asarray(fcpts, dtype=np.uint8)
+    values, stages = {}, []
+    tried = {}      # relation index -> unknowns left when it was ambiguous
+    while True:
+        best = None
+        for i, rel in enumerate(model.relations):
+            left = sorted(model.unknowns(rel) - values.keys())
+            if len(left) > max_unknowns or len(left) >= tried.get(i, 1 << 30):
+                continue
+            if not left:
+                continue
+            if best is None or len(left) < len(best[1]):
+                best = (i, left)
+        if best is None:
+            return values, stages, "ok" if all(f"k{p}" in values for p in range(16)) else "partial"
+
+        i, left = best
+        terms, rhs = model.relations[i]
+        grid = np.indices((256,) * len(left)).reshape(len(left), -1).astype(np.uint8)
+        env = dict(values)
+        env.update(zip(left, grid))
+        ok = np.ones(grid.shape[1], dtype=bool)
+        target = evaluate(rhs, env)
+        for c, f in zip(ccpts, fcpts):
+            lhs = np.uint8(0)
+            for coef, j in terms:
+                p = model.pos[j]
+                k = env[f"k{p}"]
+                d = INV_S[c[p] ^ k] ^ INV_S[f[p] ^ k ^ evaluate(model.dk[model.nr][p], env)]
+                lhs = lhs ^ GMUL[coef][d]
+            ok &= np.broadcast_to(lhs == target, ok.shape)
+        count = int(ok.sum())
+        if count == 0:
+            return values, stages, "inconsistent"
+        if count > 1:
+            tried[i] = len(left)
+            continue
+        idx = int(np.flatnonzero(ok)[0])
+        for name, g in zip(left, grid):
+            values[name] = int(g[idx])
+        stages.append(left)
+
+
+# ----------------------------------------------------------------------------
+# Reference AES with the skipped store
+# ----------------------------------------------------------------------------
+
+def expand_key(key, iteration=-1):
+    """Round keys (lists of 16 bytes) with round constant `iteration` at zero"""
+    nk, nr = len(key) // 4, rounds(8 * len(key))
+    w = [list(key[4 * i:4 * i + 4]) for i in range(nk)]
+    for n in range(nk, 4 * (nr + 1)):
+        t = list(w[n - 1])
+        if n % nk == 0:
+            t = [SBOX[b] for b in t[1:] + t[:1]]
+            if n // nk - 1 != iteration:
+                t[0] ^= RCON[n // nk - 1]
+        elif nk > 6 and n % nk == 4:
+            t = [SBOX[b] for b in t]
+        w.append([a ^ b for a, b in zip(w[n - nk], t)])
+    return [sum(w[4 * r:4 * r + 4], []) for r in range(nr + 1)]
+
+
+def encrypt(rk, pt):
+    s = [p ^ k for p, k in zip(pt, rk[0])]
+    for r in range(1, len(rk)):
+        s = shift_rows([SBOX[b] for b in s])
+        if r < len(rk) - 1:
+            s = [e.const for e in mix_columns([Expr(b) for b in s])]
+        s = [b ^ k for b, k in zip(s, rk[r])]
+    return bytes(s)
+
+
+def run(job):
+    """One trial of the batch: (keybits, iteration, first differing round key,
+    relations, stages, key bytes recovered, correct, seconds)"""
+    keybits, iteration, pairs, seed = job
+    rng = np.random.default_rng(seed)
+    key = bytes(rng.integers(0, 256, keybits // 8, dtype=np.uint8))
+    pts = [bytes(rng.integers(0, 256, 16, dtype=np.uint8)) for _ in range(pairs)]
+    correct, faulty = expand_key(key), expand_key(key, iteration)
+    ccpts = [encrypt(correct, p) for p in pts]
+    fcpts = [encrypt(faulty, p) for p in pts]
+
+    start = time.perf_counter()
+    model = Model(keybits, iteration)
+    values, stages, status = solve(model, np.frombuffer(b"".join(ccpts), np.uint8).reshape(-1, 16),
+                                   np.frombuffer(b"".join(fcpts), np.uint8).reshape(-1, 16))
+    elapsed = time.perf_counter() - start
+    found = [p for p in range(16) if f"k{p}" in values]
+    # no recovered byte is not a correct recovery
+    right = bool(found) and all(values[f"k{p}"] == correct[-1][p] for p in found)
+    return (keybits, iteration, model.first_round_key, len(model.relations), len(stages),
+            len(found), right and status != "inconsistent", elapsed)
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-k', '--keybits', type=int, default=128, choices=(128, 192, 256))
+    parser.add_argument('-i', '--iteration', type=int, default=7, help='Skipped round-constant store, 0..9')
+    parser.add_argument('--batch', action='store_true', help='Every key length and iteration')
+    parser.add_argument('-n', dest='pairs', type=int, default=3, help='Correct/faulty pairs per trial')
+    parser.add_argument('--trials', type=int, default=1, help='Random keys per combination')
+    parser.add_argument('-j', dest='jobs', type=int, default=os.cpu_count(), help='Worker processes')
+    parser.add_argument('--seed', type=int, default=1)
+    config = parser.parse_args()
+
+    combos = ([(k, i) for k in (128, 192, 256) for i in range(10)] if config.batch
+              else [(config.keybits, config.iteration)])
+    jobs = [(k, i, config.pairs, config.seed * 1000003 + 1009 * n + 31 * i + k)
+            for k, i in combos for n in range(config.trials)]
+
+    if not config.batch:
+        model = Model(config.keybits, config.iteration)
+        print(f"last round key difference: {model.dk[model.nr]}")
+        print(f"input difference of the last round: {model.dx}")
+        print(f"{len(model.relations)} relations")
+
+    start = time.perf_counter()
+    with multiprocessing.Pool(config.jobs) as pool:
+        results = pool.map(run, jobs)
+    print(f"{len(jobs)} trials in {time.perf_counter() - start:.1f} s, {config.pairs} pairs each\n")
+
+    print("bits  iter  first rk  relations  stages  key bytes  correct  time (s)")
+    for (k, i), group in itertools.groupby(results, key=lambda r: r[:2]):
+        group = list(group)
+        first = group[0][2]
+        right = "n/a" if all(g[5] == 0 for g in group) else f"{sum(g[6] for g in group)}/{len(group)}"
+        print(f"{k:4d}  {i:4d}  {'-' if first is None else first:>8}  {group[0][3]:9d}  "
+              f"{np.mean([g[4] for g in group]):6.1f}  {np.mean([g[5] for g in group]):6.1f}/16  "
+              f"{right:>7}  {np.mean([g[7] for g in group]):8.2f}")
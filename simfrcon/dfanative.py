@@ -0,0 +1,72 @@
+import ctypes
+import os
+
+# Native Rcon DFA key recovery (faultingrcon/dfa.c), built with
+# `cd faultingrcon && make libdfa.so`. DFA_LIB overrides the library path.
+LIBRARY = os.environ.get("DFA_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                 "faultingrcon", "libdfa.so"))
+STAGES = ["(12, 9)", "(6, delta1)", "(3, delta2)", "(5, 15)", "(8, delta0)",
+          "(5, 2)", "(1, 4)", "(11, 14)", "(0, 13)", "(7, 10)"]
+MAX_PAIRS = 64
+
+
+class DfaResult(ctypes.Structure):
+    _fields_ = [
+        ("stage",      ctypes.c_int),
+        ("count",      ctypes.c_int),
+        ("last_rk",    ctypes.c_uint8 * 16),
+        ("delta",      ctypes.c_uint8 * 3),
+        ("master_key", ctypes.c_uint8 * 16),
+    ]
+
+
+_lib = None
+
+def load_library():
+    """The loaded library, or None if it has not been built"""
+    global _lib
+    if _lib is None and os.path.exists(LIBRARY):
+        _lib = ctypes.CDLL(LIBRARY)
+        _lib.dfa_rcon_recover.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                                          ctypes.c_int, ctypes.POINTER(DfaResult)]
+        _lib.dfa_rcon_recover.restype = ctypes.c_int
+    return _lib
+
+def recover(fcpts, ccpts, threads=None):
+    """DfaResult of the native recovery from lists of 16-byte ciphertexts, None without the library"""
+    lib = load_library()
+    if lib is None or not 0 < len(fcpts) <= MAX_PAIRS:
+        return None
+    if threads is None:
+        threads = os.cpu_count() or 1
+    res = DfaResult()
+    lib.dfa_rcon_recover(b"".join(bytes(c) for c in ccpts), b"".join(bytes(f) for f in fcpts),
+                         len(fcpts), threads, ctypes.byref(res))
+    return res
+
+
+def keyrecover(fcpts, ccpts, fallback, N=3, threads=None):
+    """keyrecover() of simfrcon/keyrecovery.py and expfrcon/analyze.py: the
+    native recovery if the library is built, `fallback` (their Python loops)
+    otherwise. Prints the keys and returns True if the key is unique."""
+    assert N == len(ccpts)
+    assert N == len(fcpts)
+
+    res = recover(fcpts, ccpts, threads)
+    if res is None:
+        return fallback(fcpts, ccpts, N)
+
+    if res.stage != 0:
+        print(f"Not unique candidate: {res.count} at stage {STAGES[res.stage-1]}")
+        return False
+    print(list(res.last_rk))
+    print(list(res.delta))
+
+    print("Last round key:")
+    for v in res.last_rk: print(f"{v:02x} ", end="")
+    print()
+
+    print("Master key")
+    for v in res.master_key: print(f"{v:02x} ", end="")
+    print()
+    return True
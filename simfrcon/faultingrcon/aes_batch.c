@@ -0,0 +1,507 @@
+/*
+ * Batch AES encryption with the S-box given as data, see aes_batch.h
+ */
+
+#include "common.h"
+#include "aes_batch.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(AES_BATCH_NO_SIMD)
+#define AES_BATCH_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#define XTIME(x) ((uint8_t) (((x) << 1) ^ (((x) & 0x80) ? 0x1B : 0x00)))
+#define ROTL8(x) ((((x) << 8) & 0xFFFFFFFF) | ((x) >> 24))
+
+#if defined(__GNUC__)
+#define BATCH_THREAD_LOCAL __thread
+#else
+#define BATCH_THREAD_LOCAL _Thread_local
+#endif
+
+/*
+ * T-tables of the last S-box seen by the calling thread, as aes_gen_tables()
+ * builds FT0..FT3; rebuilt only when the S-box changes
+ */
+struct portable_tables {
+    int valid;
+    unsigned char sbox[256];
+    uint32_t T0[256], T1[256], T2[256], T3[256];
+};
+
+static BATCH_THREAD_LOCAL struct portable_tables portable_cache;
+
+static const struct portable_tables *portable_tables_for(const unsigned char sbox[256])
+{
+    struct portable_tables *t = &portable_cache;
+    int i;
+
+    if (t->valid && memcmp(t->sbox, sbox, 256) == 0) {
+        return t;
+    }
+    for (i = 0; i < 256; i++) {
+        uint8_t x = sbox[i], y = XTIME(x), z = y ^ x;
+
+        t->T0[i] = ((uint32_t) y) ^ ((uint32_t) x << 8) ^
+                   ((uint32_t) x << 16) ^ ((uint32_t) z << 24);
+        t->T1[i] = ROTL8(t->T0[i]);
+        t->T2[i] = ROTL8(t->T1[i]);
+        t->T3[i] = ROTL8(t->T2[i]);
+    }
+    memcpy(t->sbox, sbox, 256);
+    t->valid = 1;
+    return t;
+}
+
+/*
+ * Portable backend: T-tables derived from `sbox`
+ */
+static void aes_batch_encrypt_portable(const mbedtls_aes_context *ctx,
+                                       const unsigned char sbox[256],
+                                       const unsigned char *input, unsigned char *output,
+                                       size_t nblocks)
+{
+    const struct portable_tables *t = portable_tables_for(sbox);
+    const uint32_t *T0 = t->T0, *T1 = t->T1, *T2 = t->T2, *T3 = t->T3;
+    size_t n;
+    int i, r;
+
+    for (n = 0; n < nblocks; n++, input += 16, output += 16) {
+        const uint32_t *RK = ctx->buf + ctx->rk_offset;
+        uint32_t X[4], Y[4];
+
+        for (i = 0; i < 4; i++) {
+            X[i] = MBEDTLS_GET_UINT32_LE(input, 4 * i) ^ *RK++;
+        }
+
+        for (r = 1; r < ctx->nr; r++) {
+            for (i = 0; i < 4; i++) {
+                Y[i] = *RK++ ^ T0[MBEDTLS_BYTE_0(X[i])] ^
+                       T1[MBEDTLS_BYTE_1(X[(i + 1) & 3])] ^
+                       T2[MBEDTLS_BYTE_2(X[(i + 2) & 3])] ^
+                       T3[MBEDTLS_BYTE_3(X[(i + 3) & 3])];
+            }
+            memcpy(X, Y, sizeof(X));
+        }
+
+        for (i = 0; i < 4; i++) {
+            Y[i] = *RK++ ^
+                   ((uint32_t) sbox[MBEDTLS_BYTE_0(X[i])]) ^
+                   ((uint32_t) sbox[MBEDTLS_BYTE_1(X[(i + 1) & 3])] <<  8) ^
+                   ((uint32_t) sbox[MBEDTLS_BYTE_2(X[(i + 2) & 3])] << 16) ^
+                   ((uint32_t) sbox[MBEDTLS_BYTE_3(X[(i + 3) & 3])] << 24);
+        }
+        for (i = 0; i < 4; i++) {
+            MBEDTLS_PUT_UINT32_LE(Y[i], output, 4 * i);
+        }
+    }
+}
+
+#if defined(AES_BATCH_HAVE_AVX2)
+
+/*
+ * AVX2 backend: two blocks per register, BATCH_LANES registers per iteration.
+ * Byte 4c+r of a block is row r of column c of the AES state.
+ */
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define BATCH_LANES 4
+
+struct avx2_sbox {
+    __m256i T[16];      // T[h][l] = sbox[16h + l], in both 128-bit lanes
+    __m256i H[16];      // h << 4 in every byte
+};
+
+static AVX2_TARGET inline __m256i avx2_sub_bytes(const struct avx2_sbox *s, __m256i x)
+{
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    __m256i r = _mm256_setzero_si256();
+    int h;
+
+    // x ^ (h << 4) is the low nibble for the bytes of high nibble h and is
+    // >= 16 otherwise; adding 0x70 with saturation sets bit 7 of the latter,
+    // which pshufb maps to zero
+    for (h = 0; h < 16; h++) {
+        __m256i idx = _mm256_adds_epu8(_mm256_xor_si256(x, s->H[h]), bias);
+        r = _mm256_or_si256(r, _mm256_shuffle_epi8(s->T[h], idx));
+    }
+    return r;
+}
+
+static AVX2_TARGET inline __m256i avx2_mix_columns(__m256i a)
+{
+    const __m256i rot1 = _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+                                          1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+    const __m256i rot2 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                          2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot3 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    __m256i a1 = _mm256_shuffle_epi8(a, rot1);
+    __m256i a2 = _mm256_shuffle_epi8(a, rot2);
+    __m256i a3 = _mm256_shuffle_epi8(a, rot3);
+    __m256i t = _mm256_xor_si256(a, a1);
+
+    // b_r = 2 (a_r ^ a_{r+1}) ^ a_{r+1} ^ a_{r+2} ^ a_{r+3}
+    __m256i carry = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_setzero_si256(), t),
+                                     _mm256_set1_epi8(0x1B));
+    t = _mm256_xor_si256(_mm256_add_epi8(t, t), carry);
+    return _mm256_xor_si256(_mm256_xor_si256(t, a1), _mm256_xor_si256(a2, a3));
+}
+
+static AVX2_TARGET void aes_batch_encrypt_avx2(const mbedtls_aes_context *ctx,
+                                               const unsigned char sbox[256],
+                                               const unsigned char *input, unsigned char *output,
+                                               size_t nblocks)
+{
+    const __m256i shift_rows = _mm256_setr_epi8(0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11,
+                                                0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11);
+    const uint32_t *RK0 = ctx->buf + ctx->rk_offset;
+    unsigned char tail[BATCH_LANES * 32];
+    struct avx2_sbox s;
+    __m256i rk[15];
+    int h, r, l;
+
+    for (h = 0; h < 16; h++) {
+        s.T[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (sbox + 16 * h)));
+        s.H[h] = _mm256_set1_epi8((char) (h << 4));
+    }
+    for (r = 0; r <= ctx->nr; r++) {
+        rk[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (RK0 + 4 * r)));
+    }
+
+    while (nblocks > 0) {
+        size_t count = nblocks < 2 * BATCH_LANES ? nblocks : 2 * BATCH_LANES;
+        const unsigned char *in = input;
+        unsigned char *out = output;
+        __m256i x[BATCH_LANES];
+
+        if (count < 2 * BATCH_LANES) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, input, count * 16);
+            in = out = tail;
+        }
+
+        for (l = 0; l < BATCH_LANES; l++) {
+            x[l] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (in + 32 * l)), rk[0]);
+        }
+        for (r = 1; r < ctx->nr; r++) {
+            for (l = 0; l < BATCH_LANES; l++) {
+                x[l] = _mm256_shuffle_epi8(avx2_sub_bytes(&s, x[l]), shift_rows);
+                x[l] = _mm256_xor_si256(avx2_mix_columns(x[l]), rk[r]);
+            }
+        }
+        for (l = 0; l < BATCH_LANES; l++) {
+            x[l] = _mm256_shuffle_epi8(avx2_sub_bytes(&s, x[l]), shift_rows);
+            x[l] = _mm256_xor_si256(x[l], rk[ctx->nr]);
+            _mm256_storeu_si256((__m256i *) (out + 32 * l), x[l]);
+        }
+
+        if (out == tail) {
+            memcpy(output, tail, count * 16);
+        }
+        input += count * 16;
+        output += count * 16;
+        nblocks -= count;
+    }
+}
+
+/*
+ * AVX-512 VBMI backend: four blocks per register; vpermi2b looks up 128 S-box
+ * entries at once, so a full S-box layer is two lookups and a blend on bit 7
+ */
+#define VBMI_TARGET __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+
+static VBMI_TARGET inline __m512i vbmi_mix_columns(__m512i a)
+{
+    const __m512i rot1 = _mm512_broadcast_i32x4(_mm_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4,
+                                                              9, 10, 11, 8, 13, 14, 15, 12));
+    const __m512i rot2 = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5,
+                                                              10, 11, 8, 9, 14, 15, 12, 13));
+    const __m512i rot3 = _mm512_broadcast_i32x4(_mm_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6,
+                                                              11, 8, 9, 10, 15, 12, 13, 14));
+    __m512i a1 = _mm512_shuffle_epi8(a, rot1);
+    __m512i a2 = _mm512_shuffle_epi8(a, rot2);
+    __m512i a3 = _mm512_shuffle_epi8(a, rot3);
+    __m512i t = _mm512_xor_si512(a, a1);
+
+    t = _mm512_xor_si512(_mm512_add_epi8(t, t),
+                         _mm512_maskz_mov_epi8(_mm512_movepi8_mask(t), _mm512_set1_epi8(0x1B)));
+    return _mm512_xor_si512(_mm512_xor_si512(t, a1), _mm512_xor_si512(a2, a3));
+}
+
+static VBMI_TARGET void aes_batch_encrypt_vbmi(const mbedtls_aes_context *ctx,
+                                               const unsigned char sbox[256],
+                                               const unsigned char *input, unsigned char *output,
+                                               size_t nblocks)
+{
+    const __m512i shift_rows = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 5, 10, 15, 4, 9, 14, 3,
+                                                                    8, 13, 2, 7, 12, 1, 6, 11));
+    const __m512i lo0 = _mm512_loadu_si512(sbox), lo1 = _mm512_loadu_si512(sbox + 64);
+    const __m512i hi0 = _mm512_loadu_si512(sbox + 128), hi1 = _mm512_loadu_si512(sbox + 192);
+    const uint32_t *RK0 = ctx->buf + ctx->rk_offset;
+    __m512i rk[15];
+    int r, l;
+
+    for (r = 0; r <= ctx->nr; r++) {
+        rk[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) (RK0 + 4 * r)));
+    }
+
+#define VBMI_SUB_SHIFT(x)                                                          \
+    _mm512_shuffle_epi8(_mm512_mask_blend_epi8(_mm512_movepi8_mask(x),             \
+                                               _mm512_permutex2var_epi8(lo0, x, lo1), \
+                                               _mm512_permutex2var_epi8(hi0, x, hi1)), \
+                        shift_rows)
+
+    while (nblocks > 0) {
+        size_t count = nblocks < 4 * BATCH_LANES ? nblocks : 4 * BATCH_LANES;
+        __mmask64 mask[BATCH_LANES];
+        __m512i x[BATCH_LANES];
+
+        for (l = 0; l < BATCH_LANES; l++) {
+            size_t n = count > 4 * (size_t) l ? count - 4 * (size_t) l : 0;
+
+            mask[l] = n >= 4 ? ~(__mmask64) 0 : (((__mmask64) 1 << (16 * n)) - 1);
+            x[l] = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask[l], input + 64 * l), rk[0]);
+        }
+        for (r = 1; r < ctx->nr; r++) {
+            for (l = 0; l < BATCH_LANES; l++) {
+                x[l] = _mm512_xor_si512(vbmi_mix_columns(VBMI_SUB_SHIFT(x[l])), rk[r]);
+            }
+        }
+        for (l = 0; l < BATCH_LANES; l++) {
+            x[l] = _mm512_xor_si512(VBMI_SUB_SHIFT(x[l]), rk[ctx->nr]);
+            _mm512_mask_storeu_epi8(output + 64 * l, mask[l], x[l]);
+        }
+
+        input += count * 16;
+        output += count * 16;
+        nblocks -= count;
+    }
+#undef VBMI_SUB_SHIFT
+}
+
+/*
+ * FIPS-197 S-box, the one of the AES instructions
+ */
+static const unsigned char AES_SBOX[256] =
+{
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5,
+    0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0,
+    0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC,
+    0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A,
+    0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0,
+    0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B,
+    0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85,
+    0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5,
+    0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17,
+    0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88,
+    0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C,
+    0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9,
+    0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6,
+    0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E,
+    0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94,
+    0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68,
+    0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+/*
+ * AES-NI backend for the FIPS-197 S-box: the round keys of `ctx` may be
+ * faulted, the S-box may not. AESNI_LANES independent blocks per iteration
+ * hide the latency of aesenc.
+ */
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#define AESNI_LANES  8
+
+static AESNI_TARGET void aes_batch_encrypt_aesni(const mbedtls_aes_context *ctx,
+                                                 const unsigned char *input, unsigned char *output,
+                                                 size_t nblocks)
+{
+    const uint32_t *RK0 = ctx->buf + ctx->rk_offset;
+    __m128i rk[15], x[AESNI_LANES];
+    int r, l, lanes;
+
+    for (r = 0; r <= ctx->nr; r++) {
+        rk[r] = _mm_loadu_si128((const __m128i *) (RK0 + 4 * r));
+    }
+
+    while (nblocks > 0) {
+        lanes = nblocks < AESNI_LANES ? (int) nblocks : AESNI_LANES;
+
+        for (l = 0; l < lanes; l++) {
+            x[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (input + 16 * l)), rk[0]);
+        }
+        for (r = 1; r < ctx->nr; r++) {
+            for (l = 0; l < lanes; l++) {
+                x[l] = _mm_aesenc_si128(x[l], rk[r]);
+            }
+        }
+        for (l = 0; l < lanes; l++) {
+            _mm_storeu_si128((__m128i *) (output + 16 * l), _mm_aesenclast_si128(x[l], rk[ctx->nr]));
+        }
+
+        input += 16 * lanes;
+        output += 16 * lanes;
+        nblocks -= lanes;
+    }
+}
+
+/*
+ * VAES backend: the AES-NI backend on four blocks per register, with masked
+ * loads and stores for the last iteration as in the VBMI backend
+ */
+#define VAES_TARGET __attribute__((target("vaes,avx512f,avx512bw")))
+
+static VAES_TARGET void aes_batch_encrypt_vaes(const mbedtls_aes_context *ctx,
+                                               const unsigned char *input, unsigned char *output,
+                                               size_t nblocks)
+{
+    const uint32_t *RK0 = ctx->buf + ctx->rk_offset;
+    __m512i rk[15];
+    int r, l;
+
+    for (r = 0; r <= ctx->nr; r++) {
+        rk[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) (RK0 + 4 * r)));
+    }
+
+    while (nblocks > 0) {
+        size_t count = nblocks < 4 * BATCH_LANES ? nblocks : 4 * BATCH_LANES;
+        __mmask64 mask[BATCH_LANES];
+        __m512i x[BATCH_LANES];
+
+        for (l = 0; l < BATCH_LANES; l++) {
+            size_t n = count > 4 * (size_t) l ? count - 4 * (size_t) l : 0;
+
+            mask[l] = n >= 4 ? ~(__mmask64) 0 : (((__mmask64) 1 << (16 * n)) - 1);
+            x[l] = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask[l], input + 64 * l), rk[0]);
+        }
+        for (r = 1; r < ctx->nr; r++) {
+            for (l = 0; l < BATCH_LANES; l++) {
+                x[l] = _mm512_aesenc_epi128(x[l], rk[r]);
+            }
+        }
+        for (l = 0; l < BATCH_LANES; l++) {
+            _mm512_mask_storeu_epi8(output + 64 * l, mask[l], _mm512_aesenclast_epi128(x[l], rk[ctx->nr]));
+        }
+
+        input += count * 16;
+        output += count * 16;
+        nblocks -= count;
+    }
+}
+
+enum aes_batch_impl {
+    AES_BATCH_PORTABLE = 0,
+    AES_BATCH_AVX2,
+    AES_BATCH_VBMI,
+    AES_BATCH_AESNI,
+    AES_BATCH_VAES
+};
+
+static enum aes_batch_impl aes_batch_select(void)
+{
+    static int impl = -1;
+
+    if (impl < 0) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw")) {
+            impl = AES_BATCH_VBMI;
+        } else if (__builtin_cpu_supports("avx2")) {
+            impl = AES_BATCH_AVX2;
+        } else {
+            impl = AES_BATCH_PORTABLE;
+        }
+    }
+    return (enum aes_batch_impl) impl;
+}
+
+/*
+ * Backend for the FIPS-197 S-box: the AES instructions if the CPU has them
+ * (and AES_BATCH_NO_AESNI is not defined), the S-box-as-data backend otherwise
+ */
+static enum aes_batch_impl aes_batch_select_clean(void)
+{
+    static int impl = -1;
+
+    if (impl < 0) {
+        impl = aes_batch_select();
+#if !defined(AES_BATCH_NO_AESNI)
+        if (__builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f") &&
+            __builtin_cpu_supports("avx512bw")) {
+            impl = AES_BATCH_VAES;
+        } else if (__builtin_cpu_supports("aes")) {
+            impl = AES_BATCH_AESNI;
+        }
+#endif
+    }
+    return (enum aes_batch_impl) impl;
+}
+
+static const char *aes_batch_name(int impl)
+{
+    switch (impl) {
+        case AES_BATCH_VAES:  return "vaes";
+        case AES_BATCH_AESNI: return "aesni";
+        case AES_BATCH_VBMI:  return "avx512vbmi";
+        case AES_BATCH_AVX2:  return "avx2";
+        default:              return "portable";
+    }
+}
+#endif /* AES_BATCH_HAVE_AVX2 */
+
+void aes_batch_encrypt(const mbedtls_aes_context *ctx, const unsigned char sbox[256],
+                       const unsigned char *input, unsigned char *output, size_t nblocks)
+{
+#if defined(AES_BATCH_HAVE_AVX2)
+    switch (memcmp(sbox, AES_SBOX, 256) == 0 ? aes_batch_select_clean() : aes_batch_select()) {
+        case AES_BATCH_VAES:
+            aes_batch_encrypt_vaes(ctx, input, output, nblocks);
+            return;
+        case AES_BATCH_AESNI:
+            aes_batch_encrypt_aesni(ctx, input, output, nblocks);
+            return;
+        case AES_BATCH_VBMI:
+            aes_batch_encrypt_vbmi(ctx, sbox, input, output, nblocks);
+            return;
+        case AES_BATCH_AVX2:
+            aes_batch_encrypt_avx2(ctx, sbox, input, output, nblocks);
+            return;
+        default:
+            break;
+    }
+#endif
+    aes_batch_encrypt_portable(ctx, sbox, input, output, nblocks);
+}
+
+const char *aes_batch_backend(void)
+{
+#if defined(AES_BATCH_HAVE_AVX2)
+    return aes_batch_name(aes_batch_select());
+#else
+    return "portable";
+#endif
+}
+
+const char *aes_batch_backend_for(const unsigned char sbox[256])
+{
+#if defined(AES_BATCH_HAVE_AVX2)
+    if (memcmp(sbox, AES_SBOX, 256) == 0) {
+        return aes_batch_name(aes_batch_select_clean());
+    }
+#endif
+    return aes_batch_backend();
+}
@@ -0,0 +1,41 @@
+/**
+ * \file aes_batch.h
+ *
+ * \brief Batch AES encryption with the S-box given as data
+ *
+ * Encrypts many blocks per call with the round keys of an mbedtls context and
+ * an arbitrary (possibly faulted) forward S-box, so any substituted entry is
+ * reproduced exactly. On x86 the S-box is looked up in registers, with
+ * AVX-512 VBMI `vpermi2b` over two 128-entry halves or with AVX2 `pshufb`
+ * over sixteen 16-entry nibble tables; other CPUs use T-tables derived from
+ * the same S-box. When the S-box is the FIPS-197 one, e.g. for the correct
+ * ciphertexts or a faulted key schedule, the blocks go through the AES
+ * instructions instead (VAES or AES-NI) if the CPU has them.
+ */
+
+#ifndef AES_BATCH_H
+#define AES_BATCH_H
+
+#include <stddef.h>
+#include "aes.h"
+
+/*
+ * Encrypt `nblocks` 16-byte blocks of `input` into `output` (which may alias)
+ * with the round keys of `ctx` and the forward S-box `sbox`
+ */
+void aes_batch_encrypt(const mbedtls_aes_context *ctx, const unsigned char sbox[256],
+                       const unsigned char *input, unsigned char *output, size_t nblocks);
+
+/*
+ * Name of the backend selected at runtime for a faulted S-box
+ * ("avx512vbmi", "avx2" or "portable")
+ */
+const char *aes_batch_backend(void);
+
+/*
+ * Name of the backend aes_batch_encrypt() uses with `sbox`: "vaes" or
+ * "aesni" for the FIPS-197 S-box on CPUs with them, aes_batch_backend() otherwise
+ */
+const char *aes_batch_backend_for(const unsigned char sbox[256]);
+
+#endif /* AES_BATCH_H */
@@ -0,0 +1,58 @@
+/*
+ * Binary container of simulated ciphertexts, see cptsfile.h
+ */
+
+#include "cptsfile.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+_Static_assert(sizeof(struct cpts_header) == 64, "cpts_header must be 64 bytes");
+
+int cpts_is_binary_path(const char *path)
+{
+    size_t len = strlen(path);
+
+    return len >= 4 && strcmp(path + len - 4, ".bin") == 0;
+}
+
+unsigned char *cpts_create(const char *path, const struct cpts_header *hdr,
+                           struct cpts_map *map)
+{
+    size_t size = sizeof(*hdr) + (size_t) hdr->count * CPTS_RECORD_SIZE;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    memcpy(base, hdr, sizeof(*hdr));
+    map->base = base;
+    map->size = size;
+    return (unsigned char *) base + sizeof(*hdr);
+}
+
+int cpts_close(struct cpts_map *map)
+{
+    int ret = 0;
+
+    if (map->base != NULL) {
+        ret = munmap(map->base, map->size);
+        map->base = NULL;
+        map->size = 0;
+    }
+    return ret;
+}
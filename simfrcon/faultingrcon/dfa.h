@@ -0,0 +1,45 @@
+/**
+ * \file dfa.h
+ *
+ * \brief Key recovery of the Rcon fault of faultingrcon
+ *
+ * Native version of keyrecover() in keyrecovery.py. Skipping the update of
+ * rc[7] leaves a difference in round key 8 that goes through the MixColumns
+ * of round 9; the last round key is recovered byte pair by byte pair from
+ * correct/faulty ciphertext pairs, in the same ten stages. Each stage uses
+ * inverse S-box difference tables of the pairs, rejects a candidate on the
+ * first pair that contradicts it and splits the candidates across threads.
+ * Built as libdfa.so for keyrecovery.py and expfrcon/analyze.py.
+ */
+
+#ifndef DFA_H
+#define DFA_H
+
+#include <stdint.h>
+
+#define DFA_STAGES      10
+#define DFA_MAX_PAIRS   64
+#define DFA_MAX_THREADS 64
+
+struct dfa_result {
+    int stage;                  // 1-based stage without a unique candidate, 0 on success
+    int count;                  // candidates left at that stage
+    uint8_t last_rk[16];        // round key 10, bytes of the stages solved so far
+    uint8_t delta[3];           // fault differences of the MixColumns inputs
+    uint8_t master_key[16];     // valid on success
+};
+
+/*
+ * Recover the key from `n` pairs of correct (`ccpts`) and faulty (`fcpts`)
+ * 16-byte ciphertexts of the same plaintexts, on `threads` threads.
+ * Returns 0 if every stage left a single candidate, -1 otherwise.
+ */
+int dfa_rcon_recover(const uint8_t *ccpts, const uint8_t *fcpts, int n, int threads,
+                     struct dfa_result *res);
+
+/*
+ * Invert the fault-free AES-128 key schedule from round key 10
+ */
+void dfa_inverse_key_schedule(const uint8_t last_rk[16], uint8_t master_key[16]);
+
+#endif /* DFA_H */
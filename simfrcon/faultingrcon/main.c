@@ -22,6 +22,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "prng.h"
+#include "cptsfile.h"
+#include "aes_batch.h"
+#include "sim.h"
+
+#define MAX_THREADS 256
 
 /*
  * Forward S-box & tables
@@ -47,6 +55,23 @@ MBEDTLS_MAYBE_UNUSED static uint32_t RT3[256];
  */
 MBEDTLS_MAYBE_UNUSED static uint32_t round_constants[10];
 
+/*
+ * Fault model recorded in the header of a .bin container (cptsfile.py)
+ */
+enum fault_model {
+    FAULT_MODEL_NONE = 0,   // clean round constants
+    FAULT_MODEL_RCON_SKIP   // store of round constant `fault_location` skipped
+};
+
+/*
+ * Iteration of the round-constant loop whose store is skipped (-f), -1 for none
+ */
+#ifdef INJECT_FAULT
+static int fault_iteration = 7;
+#else
+static int fault_iteration = -1;
+#endif
+
 /*
  * Tables generation code
  */
@@ -76,10 +101,8 @@ MBEDTLS_MAYBE_UNUSED static void aes_gen_tables(void)
      * calculate the round constants
      */
     for (i = 0, x = 1; i < 10; i++) {
-#ifdef INJECT_FAULT
-        if (i == 7){} // skip instruction
+        if (i == fault_iteration){} // skip instruction
         else
-#endif
         round_constants[i] = x;
         x = XTIME(x);
     }
@@ -621,6 +644,7 @@ exit:
 }
 #endif /* MBEDTLS_CIPHER_MODE_CBC */
 
+#if !defined(SIM_LIBRARY)
 static const unsigned char aes_test_ecb_enc[][16] =
 {
     { 0xC3, 0x4C, 0x05, 0x2C, 0xC0, 0xDA, 0x8D, 0x73,
@@ -712,6 +736,40 @@ int self_test_cbc128_enc()
     return ret;
 }
 
+/*
+ * Check aes_batch_encrypt() against mbedtls_aes_crypt_ecb() under the
+ * current (possibly faulted) key schedule
+ */
+int self_test_batch_enc()
+{
+    int ret = 0, i;
+    unsigned char key[16];
+    unsigned char ref[37 * 16];
+    unsigned char buf[37 * 16];
+
+    mbedtls_aes_context ctx;
+    mbedtls_aes_init(&ctx);
+    for (i=0; i<16; i++) key[i] = (unsigned char) (17 * i + 1);
+    mbedtls_aes_setkey_enc(&ctx, key, 128);
+
+    // An odd block count exercises the partial batches too
+    for (i=0; i<37; i++){
+        prng_block(0, i, buf + 16 * i);
+        mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, buf + 16 * i, ref + 16 * i);
+    }
+    aes_batch_encrypt(&ctx, FSb, buf, buf, 37);
+
+    if (memcmp(buf, ref, sizeof(ref)) != 0) {
+        ret = 1;
+        printf("[FAILED] Batch encryption (%s)!\n", aes_batch_backend_for(FSb));
+    }
+    else {
+        printf("[PASSED] Batch encryption (%s)!\n", aes_batch_backend_for(FSb));
+    }
+    mbedtls_aes_free(&ctx);
+    return ret;
+}
+
 // S-box reference
 static const unsigned char RFSb[256] =
 {
@@ -762,12 +820,318 @@ static const uint8_t plaintexts[3][16] = {
     {0x7e, 0x1c, 0xa7, 0x1c, 0x7c, 0xa3, 0xbf, 0x7a, 0xd7, 0xd9, 0xd3, 0xc4, 0x1c, 0x00, 0xaf, 0x70}
 };
 
+/*
+ * Ciphertexts are produced in chunks of CHUNK_BLOCKS blocks, each chunk split
+ * across the worker threads. Text output is formatted as fixed-width hex lines
+ * and written out per chunk; binary output goes straight into the mapped file.
+ */
+#define CHUNK_BLOCKS (1u << 18)
+#define LINE_LEN     33     // 32 hex digits and '\n'
+#define BATCH_BLOCKS 64     // blocks per aes_batch_encrypt() call in a worker
+
+struct gen_job {
+    const unsigned char *key;
+    unsigned int keybits;
+    int use_seed;           // 0: the built-in plaintexts
+    uint64_t seed;
+    uint64_t first;         // campaign index of the first block
+    size_t count;
+    int binary;
+    unsigned char *out;     // count * 16 bytes (binary) or count * LINE_LEN bytes
+    int ret;
+};
+
+static void *gen_worker(void *arg)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    struct gen_job *job = arg;
+    unsigned char buf[BATCH_BLOCKS * 16];
+    mbedtls_aes_context ctx;
+    size_t i, k, count;
+    int j;
+
+    mbedtls_aes_init(&ctx);
+    job->ret = mbedtls_aes_setkey_enc(&ctx, job->key, job->keybits);
+
+    // The fault sits in the round keys of ctx; the S-box itself is clean
+    for (i = 0; i < job->count && job->ret == 0; i += count){
+        unsigned char *blocks = job->binary ? job->out + i * 16 : buf;
+
+        count = (job->count - i < BATCH_BLOCKS) ? job->count - i : BATCH_BLOCKS;
+        for (k = 0; k < count; k++) {
+            if (job->use_seed) prng_block(job->seed, job->first + i + k, blocks + k * 16);
+            else memcpy(blocks + k * 16, plaintexts[job->first + i + k], 16);
+        }
+        aes_batch_encrypt(&ctx, FSb, blocks, blocks, count);
+        if (job->binary) {
+            continue;
+        }
+        for (k = 0; k < count; k++) {
+            unsigned char *line = job->out + (i + k) * LINE_LEN;
+
+            for (j = 0; j < 16; j++){
+                line[2*j]   = hex[buf[16*k+j] >> 4];
+                line[2*j+1] = hex[buf[16*k+j] & 0xF];
+            }
+            line[32] = '\n';
+        }
+    }
+
+    mbedtls_aes_free(&ctx);
+    return NULL;
+}
+
+/*
+ * Encrypt N plaintexts on `threads` threads and write the ciphertexts into
+ * `path`: a binary container (see cptsfile.h) if it ends with ".bin", one hex
+ * line per block otherwise
+ */
+static int collect_ciphertexts(const unsigned char *key, unsigned int keybits, uint64_t N, int use_seed,
+                               uint64_t seed, int threads, const char *path)
+{
+    struct gen_job jobs[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    int binary = cpts_is_binary_path(path);
+    struct cpts_map map = {NULL, 0};
+    unsigned char *records = NULL, *out = NULL;
+    FILE *file = NULL;
+    uint64_t done;
+    int t, ret = 0;
+
+    if (binary) {
+        struct cpts_header hdr;
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, CPTS_MAGIC, sizeof(CPTS_MAGIC));
+        hdr.version = CPTS_VERSION;
+        hdr.record_size = CPTS_RECORD_SIZE;
+        hdr.fault_model = (fault_iteration >= 0) ? FAULT_MODEL_RCON_SKIP : FAULT_MODEL_NONE;
+        hdr.fault_location = fault_iteration;
+        hdr.key_id = 0;
+        hdr.seed = use_seed ? seed : 0;
+        hdr.count = N;
+
+        records = cpts_create(path, &hdr, &map);
+        if (records == NULL) {
+            printf("Failed to create file %s\n", path);
+            return 1;
+        }
+    } else {
+        file = fopen(path, "w");
+        if (file == NULL){
+            printf("Failed to open file %s\n", path);
+            return 1;
+        }
+
+        out = malloc((size_t) CHUNK_BLOCKS * LINE_LEN);
+        if (out == NULL) {
+            printf("Failed to allocate the output buffer\n");
+            fclose(file);
+            return 1;
+        }
+    }
+
+    for (done = 0; done < N && ret == 0; ) {
+        size_t chunk = (N - done < CHUNK_BLOCKS) ? (size_t) (N - done) : CHUNK_BLOCKS;
+        size_t share = (chunk + threads - 1) / threads;
+        size_t offset = 0;
+        int spawned = 0;
+
+        for (t = 0; t < threads && offset < chunk; t++, spawned++) {
+            jobs[t].key = key;
+            jobs[t].keybits = keybits;
+            jobs[t].use_seed = use_seed;
+            jobs[t].seed = seed;
+            jobs[t].first = done + offset;
+            jobs[t].count = (chunk - offset < share) ? chunk - offset : share;
+            jobs[t].binary = binary;
+            jobs[t].out = binary ? records + (done + offset) * CPTS_RECORD_SIZE
+                                 : out + offset * LINE_LEN;
+            offset += jobs[t].count;
+            pthread_create(&tids[t], NULL, gen_worker, &jobs[t]);
+        }
+        for (t = 0; t < spawned; t++) {
+            pthread_join(tids[t], NULL);
+            if (jobs[t].ret != 0) {
+                printf("[FAILED] ECB encryption!\n");
+                ret = jobs[t].ret;
+            }
+        }
+
+        if (ret == 0 && !binary && fwrite(out, LINE_LEN, chunk, file) != chunk) {
+            printf("Failed to write file %s\n", path);
+            ret = 1;
+        }
+        done += chunk;
+    }
+
+    if (binary) {
+        cpts_close(&map);
+    } else {
+        free(out);
+        fclose(file);
+    }
+    return ret;
+}
+
+#endif /* !SIM_LIBRARY */
+
+/*
+ * Shared-library interface (sim.h): `make libsim.so` builds this file with
+ * -DSIM_LIBRARY, without main(), for simlib.py. The tables are global, so a
+ * process simulates one fault at a time. Every buffer belongs to the caller.
+ */
+size_t sim_context_size(void)
+{
+    return sizeof(mbedtls_aes_context);
+}
+
+/*
+ * Regenerate the tables with the store of round constant `iteration`
+ * skipped (-1: no fault). The skipped constant is left at zero, as in a
+ * fresh process. Contexts set up before keep their round keys.
+ */
+int sim_set_fault(int iteration)
+{
+    if (iteration < -1 || iteration > 9) {
+        return -1;
+    }
+    fault_iteration = iteration;
+    memset(round_constants, 0, sizeof(round_constants));
+    aes_gen_tables();
+    aes_init_done = 1;
+    return 0;
+}
+
+void sim_get_sbox(unsigned char sbox[256])
+{
+    memcpy(sbox, FSb, 256);
+}
+
+void sim_get_round_constants(uint32_t rcon[10])
+{
+    memcpy(rcon, round_constants, sizeof(round_constants));
+}
+
+/*
+ * Key schedule of `key` under the current (faulted) round constants into
+ * `ctx`, a buffer of sim_context_size() bytes
+ */
+int sim_setkey(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    mbedtls_aes_init(ctx);
+    return mbedtls_aes_setkey_enc(ctx, key, keybits);
+}
+
+/*
+ * Round keys of `ctx` as 4 * (nr + 1) little-endian words; returns nr
+ */
+int sim_round_keys(const mbedtls_aes_context *ctx, uint32_t *rk)
+{
+    memcpy(rk, ctx->buf + ctx->rk_offset, sizeof(uint32_t) * 4 * (ctx->nr + 1));
+    return ctx->nr;
+}
+
+/*
+ * Plaintexts first..first+n-1 of the stream of `seed`, as main -s seed
+ */
+void sim_plaintexts(uint64_t seed, uint64_t first, unsigned char *pts, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        prng_block(seed, first + i, pts + 16 * i);
+    }
+}
+
+void sim_encrypt(const mbedtls_aes_context *ctx, const unsigned char *pts, unsigned char *cpts,
+                 size_t n)
+{
+    aes_batch_encrypt(ctx, FSb, pts, cpts, n);
+}
+
+#if !defined(SIM_LIBRARY)
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -n, --count N         number of encryptions (default: 3)\n");
+    printf("  -s, --seed SEED       draw the plaintexts from this seed instead of\n");
+    printf("                        the 3 built-in ones\n");
+    printf("  -j, --threads T       number of encryption threads (default: 1)\n");
+    printf("  -k, --keybits BITS    key length: 128, 192 or 256 (default: 128)\n");
+    printf("  -f, --fault-iteration I\n");
+    printf("                        skip the store of round constant I, 0..9\n");
+    printf("                        (default: %d, -1 for none)\n", fault_iteration);
+#ifdef INJECT_FAULT
+    printf("  -o, --output PATH     ciphertext file (default: fcpts.txt),\n");
+#else
+    printf("  -o, --output PATH     ciphertext file (default: ccpts.txt),\n");
+#endif
+    printf("                        binary if it ends with .bin\n");
+    printf("  -h, --help            show this message\n");
+}
+
 int main(int argc, char *argv[])
 {
+    // Number of encryptions
+    uint64_t N = 3;
+    uint64_t seed = 0;
+    int use_seed = 0, threads = 1, opt;
+    unsigned int keybits = 128;
+#ifdef INJECT_FAULT
+    // Faulty ciphertexts
+    const char *output = "fcpts.txt";
+#else
+    // Correct ciphertexts
+    const char *output = "ccpts.txt";
+#endif
+
+    static const struct option long_options[] = {
+        {"count",   required_argument, NULL, 'n'},
+        {"seed",    required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 'j'},
+        {"keybits", required_argument, NULL, 'k'},
+        {"fault-iteration", required_argument, NULL, 'f'},
+        {"output",  required_argument, NULL, 'o'},
+        {"help",    no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "n:s:j:k:f:o:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': N = strtoull(optarg, NULL, 0); break;
+            case 's': seed = strtoull(optarg, NULL, 0); use_seed = 1; break;
+            case 'j': threads = atoi(optarg); break;
+            case 'k': keybits = (unsigned int) atoi(optarg); break;
+            case 'f': fault_iteration = atoi(optarg); break;
+            case 'o': output = optarg; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (!use_seed && N > 3) {
+        printf("Only 3 built-in plaintexts, use --seed for more\n");
+        return 1;
+    }
+    if (threads < 1 || threads > MAX_THREADS) {
+        printf("--threads must be in [1,%d]\n", MAX_THREADS);
+        return 1;
+    }
+    if (keybits != 128 && keybits != 192 && keybits != 256) {
+        printf("--keybits must be 128, 192 or 256\n");
+        return 1;
+    }
+    if (fault_iteration < -1 || fault_iteration > 9) {
+        printf("--fault-iteration must be in [-1,9]\n");
+        return 1;
+    }
+
     self_test_ecb128_enc();
     self_test_cbc128_enc();
+    self_test_batch_enc();
 
-    int i, j;
+    int i;
 
     for (i = 0; i < 10; i++){
         printf("rc[%d]: %02x\n", i, round_constants[i]);
@@ -793,41 +1157,12 @@ int main(int argc, char *argv[])
     }
 #endif
 
-#ifdef INJECT_FAULT
-    // Faulty ciphertexts
-    FILE *file = fopen("fcpts.txt", "w");
-#else
-    // Correct ciphertexts
-    FILE *file = fopen("ccpts.txt", "w");
-#endif
-    if (file == NULL){
-        printf("Failed to open file");
-        return 1;
-    }
-
-    // Number of encryptions
-    unsigned int N = 3;
-    unsigned char key[16] = {0x5b, 0x12, 0xa4, 0x7f, 0x2b, 0x55, 0x71, 0x19, 
-                             0x1e, 0xc0, 0x6d, 0x7c, 0x02, 0xfc, 0x60, 0x76};
-    int ret = 0, mode=MBEDTLS_AES_ENCRYPT;
-    unsigned int keybits = 128;
-    unsigned char buf[16];
-    mbedtls_aes_context ctx;
-    mbedtls_aes_init(&ctx);
-    mbedtls_aes_setkey_enc(&ctx, key, keybits);
-
-    
-    for (i = 0; i < N; i++){
-        for (j = 0; j < 16; j++) buf[j] = plaintexts[i][j];
-        ret = mbedtls_aes_crypt_ecb(&ctx, mode, buf, buf);
-        if (ret != 0) {
-            printf("[FAILED] ECB encryption!\n");
-            return ret;
-        }
-        for (j = 0; j < 16; j++) fprintf(file, "%02X", buf[j]); fprintf(file, "\n");
-    }
-
-    fclose(file);
+    // The first keybits / 8 bytes are used
+    unsigned char key[32] = {0x5b, 0x12, 0xa4, 0x7f, 0x2b, 0x55, 0x71, 0x19, 
+                             0x1e, 0xc0, 0x6d, 0x7c, 0x02, 0xfc, 0x60, 0x76,
+                             0x3a, 0x94, 0xd1, 0x07, 0xe8, 0x4f, 0x26, 0xb3,
+                             0x71, 0x0c, 0x9d, 0x58, 0xc2, 0x6e, 0x15, 0xfa};
 
-    return 0;
-}
\ No newline at end of file
+    return collect_ciphertexts(key, keybits, N, use_seed, seed, threads, output);
+}
+#endif /* !SIM_LIBRARY */
@@ -0,0 +1,233 @@
+/*
+ * Monte Carlo estimate of the pairs needed by the Rcon DFA
+ *
+ * Each trial draws a key and MC_MAX_PAIRS plaintexts from the counter-based
+ * generator, encrypts them under the correct key schedule and under the one
+ * of the faulted aes_gen_tables() (round_constants[7] left at zero), then runs
+ * dfa_rcon_recover() on the first 1, 2, ... pairs. A recovery counts as
+ * unique when every stage leaves a single candidate, and as correct when the
+ * master key it returns is the drawn one. The tables, key schedules and
+ * encryption are those of main.c, linked in with -DSIM_LIBRARY (sim.h).
+ * Their tables are global, so trials run by blocks: the main thread sets up
+ * the correct and the faulty contexts of a block, one fault at a time, then
+ * the threads encrypt and recover. Trial t only depends on (seed, t).
+ */
+
+#include "common.h"
+#include "aes.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "prng.h"
+#include "aes_batch.h"
+#include "sim.h"
+#include "dfa.h"
+
+#define MAX_THREADS  256
+#define MC_MAX_PAIRS 8
+#define MC_Z         1.959964       // two-sided 95% normal quantile
+#define MC_BLOCK     4096           // trials whose contexts are set up at once
+#define MC_ITERATION 7              // skipped round-constant store
+
+struct mc_counts {
+    uint64_t unique;                    // one candidate at every stage
+    uint64_t correct;                   // ... and the drawn master key
+    uint64_t failed[DFA_STAGES + 1];    // first stage without a unique candidate
+};
+
+struct mc_job {
+    uint64_t seed;
+    uint64_t block;                     // trial of the first context
+    uint64_t first, step, trials;       // trials block + first, + step, ...
+    int pairs;
+    const mbedtls_aes_context *correct, *faulty;    // indexed by trial - block
+    struct mc_counts counts[MC_MAX_PAIRS + 1];
+};
+
+static void *mc_worker(void *arg)
+{
+    struct mc_job *job = arg;
+    unsigned char key[16];
+    unsigned char pts[MC_MAX_PAIRS * 16];
+    unsigned char ccpts[MC_MAX_PAIRS * 16], fcpts[MC_MAX_PAIRS * 16];
+    struct dfa_result res;
+    uint64_t n, k, trial;
+    int pairs;
+
+    for (n = 0; n < job->trials; n++) {
+        k = job->first + n * job->step;
+        trial = job->block + k;
+
+        prng_block(job->seed, trial * (MC_MAX_PAIRS + 1), key);
+        sim_plaintexts(job->seed, trial * (MC_MAX_PAIRS + 1) + 1, pts, (size_t) job->pairs);
+        sim_encrypt(&job->correct[k], pts, ccpts, (size_t) job->pairs);
+        sim_encrypt(&job->faulty[k], pts, fcpts, (size_t) job->pairs);
+
+        for (pairs = 1; pairs <= job->pairs; pairs++) {
+            struct mc_counts *c = &job->counts[pairs];
+
+            if (dfa_rcon_recover(ccpts, fcpts, pairs, 1, &res) == 0) {
+                c->unique++;
+                c->correct += memcmp(res.master_key, key, 16) == 0;
+            } else {
+                c->failed[res.stage]++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Key schedules of trials block..block+count-1 under the tables of
+ * `iteration`; the tables stay set until the next call
+ */
+static void mc_setup(uint64_t seed, uint64_t block, uint64_t count, int iteration,
+                     mbedtls_aes_context *ctx)
+{
+    unsigned char key[16];
+    uint64_t k;
+
+    sim_set_fault(iteration);
+    for (k = 0; k < count; k++) {
+        prng_block(seed, (block + k) * (MC_MAX_PAIRS + 1), key);
+        sim_setkey(&ctx[k], key, 128);
+    }
+}
+
+/*
+ * 95% Wilson score interval of k successes out of n
+ */
+static void wilson(uint64_t k, uint64_t n, double *lo, double *hi)
+{
+    double p = (double) k / n, z2 = MC_Z * MC_Z;
+    double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+    double half = MC_Z * sqrt(p * (1 - p) / n + z2 / (4.0 * n * n)) / (1 + z2 / n);
+
+    *lo = center - half;
+    *hi = center + half;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -t, --trials N        random keys to draw (default: 10000)\n");
+    printf("  -p, --pairs P         largest number of pairs tried (default: 4, max %d)\n", MC_MAX_PAIRS);
+    printf("  -s, --seed SEED       seed of the keys and plaintexts (default: 1)\n");
+    printf("  -j, --threads T       number of threads (default: all cores)\n");
+    printf("  -h, --help            show this message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct mc_job jobs[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    struct mc_counts total[MC_MAX_PAIRS + 1];
+    mbedtls_aes_context *correct, *faulty;
+    unsigned char sbox[256];
+    uint64_t trials = 10000, seed = 1, block, count;
+    int pairs = 4, threads = (int) sysconf(_SC_NPROCESSORS_ONLN), opt, t, p, s, active;
+    struct timespec start, end;
+    double elapsed;
+
+    static const struct option long_options[] = {
+        {"trials",  required_argument, NULL, 't'},
+        {"pairs",   required_argument, NULL, 'p'},
+        {"seed",    required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 'j'},
+        {"help",    no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "t:p:s:j:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 't': trials = strtoull(optarg, NULL, 0); break;
+            case 'p': pairs = atoi(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (trials == 0) {
+        printf("--trials must be positive\n");
+        return 1;
+    }
+    if (pairs < 1 || pairs > MC_MAX_PAIRS) {
+        printf("--pairs must be in [1,%d]\n", MC_MAX_PAIRS);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if ((uint64_t) threads > trials) threads = (int) trials;
+
+    correct = malloc(MC_BLOCK * sizeof(*correct));
+    faulty = malloc(MC_BLOCK * sizeof(*faulty));
+    if (correct == NULL || faulty == NULL) {
+        printf("Failed to allocate the contexts\n");
+        return 1;
+    }
+
+    sim_set_fault(-1);
+    sim_get_sbox(sbox);
+    printf("%llu trials, 1..%d pairs, %d threads (%s)\n",
+           (unsigned long long) trials, pairs, threads, aes_batch_backend_for(sbox));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(jobs, 0, sizeof(jobs));
+    for (block = 0; block < trials; block += count) {
+        count = (trials - block < MC_BLOCK) ? trials - block : MC_BLOCK;
+        mc_setup(seed, block, count, -1, correct);
+        mc_setup(seed, block, count, MC_ITERATION, faulty);
+
+        // The tables are left as they are while the threads encrypt
+        active = ((uint64_t) threads > count) ? (int) count : threads;
+        for (t = 0; t < active; t++) {
+            jobs[t].seed = seed;
+            jobs[t].block = block;
+            jobs[t].first = t;
+            jobs[t].step = active;
+            jobs[t].trials = (count - t + active - 1) / active;
+            jobs[t].pairs = pairs;
+            jobs[t].correct = correct;
+            jobs[t].faulty = faulty;
+            pthread_create(&tids[t], NULL, mc_worker, &jobs[t]);
+        }
+        for (t = 0; t < active; t++) {
+            pthread_join(tids[t], NULL);
+        }
+    }
+    memset(total, 0, sizeof(total));
+    for (t = 0; t < threads; t++) {
+        for (p = 1; p <= pairs; p++) {
+            total[p].unique += jobs[t].counts[p].unique;
+            total[p].correct += jobs[t].counts[p].correct;
+            for (s = 0; s <= DFA_STAGES; s++) total[p].failed[s] += jobs[t].counts[p].failed[s];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+
+    printf("\npairs  correct        rate   95%% interval        wrong key  first failing stage\n");
+    for (p = 1; p <= pairs; p++) {
+        double lo, hi;
+
+        wilson(total[p].correct, trials, &lo, &hi);
+        printf("%5d  %9llu  %8.4f%%  [%7.4f%%, %7.4f%%]  %9llu ",
+               p, (unsigned long long) total[p].correct, 100.0 * total[p].correct / trials,
+               100.0 * lo, 100.0 * hi, (unsigned long long) (total[p].unique - total[p].correct));
+        for (s = 1; s <= DFA_STAGES; s++) {
+            if (total[p].failed[s]) printf(" %d:%llu", s, (unsigned long long) total[p].failed[s]);
+        }
+        printf("\n");
+    }
+    printf("\n%.2f s, %.0f trials/s\n", elapsed, trials / elapsed);
+    free(correct);
+    free(faulty);
+    return 0;
+}
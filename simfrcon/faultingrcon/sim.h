@@ -0,0 +1,52 @@
+/**
+ * \file sim.h
+ *
+ * \brief Shared-library interface of the simulator
+ *
+ * main.c built with -DSIM_LIBRARY, without main(): libsim.so for simlib.py,
+ * and the key schedules of montecarlo. The tables are global, so a process
+ * simulates one fault at a time. Every buffer belongs to the caller.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "aes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+size_t sim_context_size(void);
+
+/*
+ * Regenerate the tables with the store of round constant `iteration`
+ * skipped (-1: no fault). Contexts set up before keep their round keys.
+ * Returns -1 on invalid input.
+ */
+int sim_set_fault(int iteration);
+
+void sim_get_sbox(unsigned char sbox[256]);
+
+void sim_get_round_constants(uint32_t rcon[10]);
+
+/*
+ * Key schedule of `key` under the current (faulted) round constants into `ctx`
+ */
+int sim_setkey(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits);
+
+/*
+ * Round keys of `ctx` as 4 * (nr + 1) little-endian words; returns nr
+ */
+int sim_round_keys(const mbedtls_aes_context *ctx, uint32_t *rk);
+
+/*
+ * Plaintexts first..first+n-1 of the stream of `seed`, as main -s seed
+ */
+void sim_plaintexts(uint64_t seed, uint64_t first, unsigned char *pts, size_t n);
+
+/*
+ * Encryption under the tables of the simulator (the S-box is never faulted)
+ */
+void sim_encrypt(const mbedtls_aes_context *ctx, const unsigned char *pts, unsigned char *cpts,
+                 size_t n);
+
+#endif /* SIM_H */
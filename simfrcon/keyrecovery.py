@@ -1,3 +1,7 @@
+import argparse
+from cptsfile import load_ciphertexts, read_header, FAULT_MODELS
+import dfanative
+
 # Constants
 RCON = [
     0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36
@@ -98,7 +102,7 @@ def inverse_key_schedule(key):
     
     return round_keys
 
-def keyrecover(fcpts, ccpts, N=3):
+def keyrecover_python(fcpts, ccpts, N=3):
     assert N == len(ccpts)
     assert N == len(fcpts)
 
@@ -407,17 +411,47 @@ def keyrecover(fcpts, ccpts, N=3):
     print()
     return True
 
+def keyrecover(fcpts, ccpts, N=3, threads=None):
+    """Native recovery of faultingrcon/libdfa.so if it is built, keyrecover_python() otherwise"""
+    return dfanative.keyrecover(fcpts, ccpts, keyrecover_python, N, threads)
+
 if __name__ == "__main__":
-    path_to_fcpts = "fcpts.txt"
-    path_to_ccpts = "ccpts.txt"
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('--fcpts', dest='path_to_fcpts',
+                        type=str,
+                        default='fcpts.txt',
+                        help='Path to the faulty ciphertext file (hex text or .bin container)')
+
+    parser.add_argument('--ccpts', dest='path_to_ccpts',
+                        type=str,
+                        default='ccpts.txt',
+                        help='Path to the correct ciphertext file (hex text or .bin container)')
+
+    parser.add_argument('--keybits', type=int, default=128, choices=(128, 192, 256),
+                        help='Key length of the simulation (faultingrcon/main -k)')
+    parser.add_argument('--fault-iteration', dest='iteration', type=int, default=None,
+                        help='Skipped round-constant store (default: from the .bin header, else 7)')
 
-    with open(path_to_fcpts, "r") as f: fcpts = f.readlines()
-    with open(path_to_ccpts, "r") as f: ccpts = f.readlines()
+    config = parser.parse_args()
 
-    fcpts = [list(bytes.fromhex(c.strip())) for c in fcpts]
-    ccpts = [list(bytes.fromhex(c.strip())) for c in ccpts]
+    fcpts = load_ciphertexts(config.path_to_fcpts)[:3].tolist()
+    ccpts = load_ciphertexts(config.path_to_ccpts)[:3].tolist()
 
     assert len(fcpts) == 3
     assert len(ccpts) == 3
 
-    keyrecover(fcpts, ccpts)
+    iteration = config.iteration
+    if iteration is None:
+        hdr = read_header(config.path_to_fcpts)
+        iteration = hdr["fault_location"] if hdr is not None and hdr["fault_model"] == FAULT_MODELS.index("rcon-skip") else 7
+
+    if (config.keybits, iteration) == (128, 7):
+        keyrecover(fcpts, ccpts)
+    else:
+        # Relations generated from the symbolic differences of the fault
+        import dfamodel
+        values, stages, status = dfamodel.solve(dfamodel.Model(config.keybits, iteration), ccpts, fcpts)
+        print(f"{len(stages)} stages, {status}")
+        print("Last round key:")
+        print(" ".join(f"{values[f'k{p}']:02x}" if f"k{p}" in values else "??" for p in range(16)))
\ No newline at end of file
@@ -0,0 +1,166 @@
+import argparse
+import ctypes
+import os
+import subprocess
+import tempfile
+import time
+import numpy as np
+from numpy.ctypeslib import ndpointer
+
+# Simulator core of faultingrcon/main.c (table generation with a skipped
+# round constant, key setup, batch encryption) built with
+# `cd faultingrcon && make libsim.so`. SIM_LIB overrides the library path.
+# Every function fills the NumPy array it is given (or allocates one) in
+# place, without copies or files.
+LIBRARY = os.environ.get("SIM_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                 "faultingrcon", "libsim.so"))
+BYTES = ndpointer(np.uint8, flags="C_CONTIGUOUS")
+WORDS = ndpointer(np.uint32, flags="C_CONTIGUOUS")
+
+
+_lib = None
+
+def load_library():
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(LIBRARY)
+        lib.sim_context_size.argtypes = []
+        lib.sim_context_size.restype = ctypes.c_size_t
+        lib.sim_set_fault.argtypes = [ctypes.c_int]
+        lib.sim_set_fault.restype = ctypes.c_int
+        lib.sim_get_sbox.argtypes = [BYTES]
+        lib.sim_get_sbox.restype = None
+        lib.sim_get_round_constants.argtypes = [WORDS]
+        lib.sim_get_round_constants.restype = None
+        lib.sim_setkey.argtypes = [BYTES, BYTES, ctypes.c_uint]
+        lib.sim_setkey.restype = ctypes.c_int
+        lib.sim_round_keys.argtypes = [BYTES, WORDS]
+        lib.sim_round_keys.restype = ctypes.c_int
+        lib.sim_plaintexts.argtypes = [ctypes.c_uint64, ctypes.c_uint64, BYTES, ctypes.c_size_t]
+        lib.sim_plaintexts.restype = None
+        lib.sim_encrypt.argtypes = [BYTES, BYTES, BYTES, ctypes.c_size_t]
+        lib.sim_encrypt.restype = None
+        _lib = lib
+    return _lib
+
+
+def _blocks(out, n):
+    """`out` as an (n,16) uint8 array, or a new one"""
+    if out is None:
+        return np.empty((n, 16), dtype=np.uint8)
+    assert out.dtype == np.uint8 and out.size == 16 * n, "Expected a uint8 buffer of n blocks"
+    return out
+
+
+def set_fault(iteration=-1):
+    """Regenerate the tables with round constant `iteration` left at zero
+    (-1: no fault). Keys set up before keep their round keys."""
+    if load_library().sim_set_fault(iteration) != 0:
+        raise ValueError(f"Invalid fault iteration {iteration}")
+
+
+def sbox(out=None):
+    out = np.empty(256, dtype=np.uint8) if out is None else out
+    load_library().sim_get_sbox(out)
+    return out
+
+
+def round_constants(out=None):
+    out = np.empty(10, dtype=np.uint32) if out is None else out
+    load_library().sim_get_round_constants(out)
+    return out
+
+
+def setkey(key, ctx=None):
+    """Context of `key` (16, 24 or 32 bytes) under the current round constants, in `ctx` if given"""
+    lib = load_library()
+    ctx = np.zeros(lib.sim_context_size(), dtype=np.uint8) if ctx is None else ctx
+    key = np.frombuffer(bytes(key), dtype=np.uint8)
+    if lib.sim_setkey(ctx, key, 8 * len(key)) != 0:
+        raise ValueError(f"Invalid key length {len(key)}")
+    return ctx
+
+
+def round_keys(ctx):
+    """Round keys of `ctx` as an (nr+1,16) uint8 array"""
+    rk = np.empty(4 * 15, dtype=np.uint32)
+    nr = load_library().sim_round_keys(ctx, rk)
+    return rk[:4 * (nr + 1)].astype("<u4").view(np.uint8).reshape(nr + 1, 16)
+
+
+def plaintexts(seed, first, n, out=None):
+    """Plaintexts first..first+n-1 of the stream of `seed`, as faultingrcon/main -s seed"""
+    out = _blocks(out, n)
+    load_library().sim_plaintexts(seed, first, out, n)
+    return out
+
+
+def encrypt(ctx, pts, out=None):
+    """Ciphertexts of the (n,16) plaintexts under the round keys of `ctx`; `out` may be `pts`"""
+    pts = np.ascontiguousarray(pts, dtype=np.uint8)
+    out = _blocks(out, len(pts.reshape(-1, 16)))
+    load_library().sim_encrypt(ctx, pts, out, len(pts.reshape(-1, 16)))
+    return out
+
+
+if __name__ == "__main__":
+    import dfamodel
+    from cptsfile import load_ciphertexts
+
+    parser = argparse.ArgumentParser(description="Check libsim.so and time it against process spawns")
+
+    parser.add_argument('--spawns', type=int, default=16,
+                        help='Runs of faultingrcon/main to time')
+
+    config = parser.parse_args()
+
+    # FIPS-197 C.1 on the clean tables
+    set_fault(-1)
+    ctx = setkey(bytes(range(16)))
+    cpt = encrypt(ctx, np.frombuffer(bytes.fromhex("00112233445566778899aabbccddeeff"), dtype=np.uint8))
+    assert bytes(cpt[0]).hex() == "69c4e0d86a7b0430d8cdb78070b4c55a"
+
+    # Every skip position and key length against the model of dfamodel.py
+    rng = np.random.default_rng(1)
+    pts = plaintexts(5, 0, 8)
+    for iteration in range(-1, 10):
+        set_fault(iteration)
+        assert (round_constants() == 0).sum() == (iteration >= 0)
+        for keybits in (128, 192, 256):
+            key = rng.bytes(keybits // 8)
+            ctx = setkey(key)
+            rk = dfamodel.expand_key(key, iteration)
+            assert (round_keys(ctx) == np.array(rk, dtype=np.uint8)).all()
+            assert [bytes(c) for c in encrypt(ctx, pts)] == [dfamodel.encrypt(rk, p) for p in pts]
+    print("[PASSED] libsim.so against FIPS-197 and dfamodel.py")
+
+    # Correct/faulty pairs of random keys, in process
+    clean, faulty = np.zeros_like(ctx), np.zeros_like(ctx)
+    ccpts, fcpts = np.empty((2, 16), dtype=np.uint8), np.empty((2, 16), dtype=np.uint8)
+    keys = [rng.bytes(16) for _ in range(1000)]
+    start = time.perf_counter()
+    for key in keys:
+        set_fault(-1)
+        setkey(key, clean)
+        set_fault(7)
+        setkey(key, faulty)
+        encrypt(clean, pts[:2], ccpts)
+        encrypt(faulty, pts[:2], fcpts)
+    lib_time = (time.perf_counter() - start) / len(keys)
+
+    # The same through faultingrcon/main and ciphertext files
+    main = os.path.join(os.path.dirname(LIBRARY), "main")
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "cpts.bin")
+        start = time.perf_counter()
+        for k in range(config.spawns):
+            for iteration in (-1, 7):
+                subprocess.run([main, "-f", str(iteration), "-s", "5", "-n", "2", "-o", path],
+                               check=True, stdout=subprocess.DEVNULL)
+                cpts = np.array(load_ciphertexts(path))
+        spawn_time = (time.perf_counter() - start) / config.spawns
+    set_fault(7)
+    assert (encrypt(setkey(bytes.fromhex("5b12a47f2b5571191ec06d7c02fc6076")), pts[:2]) == cpts).all()
+
+    print(f"Two correct/faulty pairs: {1e6 * lib_time:.1f} us in process, "
+          f"{1e3 * spawn_time:.2f} ms through faultingrcon/main ({spawn_time / lib_time:.0f}x)")
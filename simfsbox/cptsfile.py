@@ -0,0 +1,81 @@
+import itertools
+import numpy as np
+
+# Binary container written by faultingsbox/main when the output ends with .bin:
+# a 64-byte little-endian header followed by `count` raw 16-byte ciphertexts
+# (see faultingsbox/cptsfile.h).
+MAGIC = b"PFACPTS\x00"
+HEADER = np.dtype([
+    ("magic",          "S8"),
+    ("version",        "<u4"),
+    ("record_size",    "<u4"),
+    ("fault_model",    "<u4"),
+    ("fault_location", "<i4"),
+    ("key_id",         "<u4"),
+    ("reserved",       "<u4"),
+    ("seed",           "<u8"),
+    ("count",          "<u8"),
+    ("pad",            "V16"),
+])
+FAULT_MODELS = ["none", "fixed", "random", "sweep"]
+
+
+def read_header(path):
+    """Header of a binary container as a dict, or None for a hex text file"""
+    with open(path, "rb") as f: raw = f.read(HEADER.itemsize)
+    if len(raw) < HEADER.itemsize or not raw.startswith(MAGIC):
+        return None
+    hdr = np.frombuffer(raw, dtype=HEADER)[0]
+    return {name: hdr[name].item() for name in HEADER.names if name != "pad"}
+
+
+def load_ciphertexts(path):
+    """
+    Ciphertexts of `path` as an (N,16) uint8 array.
+
+    Binary containers are memory-mapped read-only, without copying the records.
+    Hex text files (one ciphertext per line) are parsed in one pass.
+    """
+    hdr = read_header(path)
+    if hdr is not None:
+        assert hdr["record_size"] == 16, f"Unsupported record size {hdr['record_size']}"
+        if hdr["count"] == 0:
+            return np.zeros((0, 16), dtype=np.uint8)
+        return np.memmap(path, dtype=np.uint8, mode="r",
+                         offset=HEADER.itemsize, shape=(hdr["count"], 16))
+
+    with open(path, "r") as f: text = "".join(f.read().split())
+    return np.frombuffer(bytes.fromhex(text), dtype=np.uint8).reshape(-1, 16)
+
+
+def iter_ciphertexts(path, chunk_size):
+    """
+    Ciphertexts of `path` as successive (<=chunk_size,16) uint8 arrays, so that
+    arbitrarily large captures are processed in bounded memory; a chunk_size
+    of 0 gives the whole file as one array.
+    """
+    if read_header(path) is not None:
+        cpts = load_ciphertexts(path)
+        step = chunk_size if chunk_size > 0 else max(len(cpts), 1)
+        for start in range(0, len(cpts), step):
+            yield cpts[start:start+step]
+        return
+
+    with open(path, "r") as f:
+        while True:
+            lines = [l.strip() for l in itertools.islice(f, chunk_size if chunk_size > 0 else None)]
+            lines = [l for l in lines if l]
+            if not lines:
+                return
+            yield np.frombuffer(bytes.fromhex("".join(lines)), dtype=np.uint8).reshape(-1, 16)
+
+
+def describe(path):
+    """One-line summary of the container metadata, empty for text files"""
+    hdr = read_header(path)
+    if hdr is None:
+        return ""
+    model = hdr["fault_model"]
+    model = FAULT_MODELS[model] if model < len(FAULT_MODELS) else str(model)
+    return (f"fault model = {model}, fault location = {hdr['fault_location']}, "
+            f"key id = {hdr['key_id']}, seed = {hdr['seed']}")
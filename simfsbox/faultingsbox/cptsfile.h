@@ -0,0 +1,56 @@
+/**
+ * \file cptsfile.h
+ *
+ * \brief Binary container of simulated ciphertexts
+ *
+ * A 64-byte little-endian header followed by `count` raw 16-byte records.
+ * Files are written and read through mmap, so the encryption threads store
+ * their output in place and the readers do not copy the records.
+ */
+
+#ifndef CPTSFILE_H
+#define CPTSFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPTS_MAGIC       "PFACPTS"
+#define CPTS_VERSION     1
+#define CPTS_RECORD_SIZE 16
+
+struct cpts_header {
+    char magic[8];              // CPTS_MAGIC, NUL-terminated
+    uint32_t version;           // CPTS_VERSION
+    uint32_t record_size;       // CPTS_RECORD_SIZE
+    uint32_t fault_model;       // enum fault_model of the simulator
+    int32_t fault_location;     // faulted index, -1 for no fault
+    uint32_t key_id;            // index of the key in the campaign
+    uint32_t reserved;
+    uint64_t seed;              // seed of the plaintext stream
+    uint64_t count;             // number of records
+    uint8_t pad[16];
+};
+
+struct cpts_map {
+    void *base;
+    size_t size;
+};
+
+/*
+ * Whether `path` names a binary container (".bin" extension)
+ */
+int cpts_is_binary_path(const char *path);
+
+/*
+ * Create `path` holding hdr->count records and map it for writing.
+ * Returns the first record, or NULL on failure.
+ */
+unsigned char *cpts_create(const char *path, const struct cpts_header *hdr,
+                           struct cpts_map *map);
+
+/*
+ * Unmap a container opened with cpts_create()
+ */
+int cpts_close(struct cpts_map *map);
+
+#endif /* CPTSFILE_H */
@@ -0,0 +1,39 @@
+/*
+ * Histogram shards of a simulated campaign, see histfile.h
+ */
+
+#include "histfile.h"
+#include <stdio.h>
+#include <string.h>
+
+_Static_assert(sizeof(struct hist_header) == 64, "hist_header must be 64 bytes");
+_Static_assert(sizeof(struct hist_sample) == 24, "hist_sample must be 24 bytes");
+
+int hist_is_shard_path(const char *path)
+{
+    size_t len = strlen(path);
+
+    return len >= 5 && strcmp(path + len - 5, ".hist") == 0;
+}
+
+int hist_write(const char *path, const struct hist_header *hdr, const uint64_t counts[16][256],
+               const struct hist_range *ranges, const struct hist_sample *samples)
+{
+    FILE *file;
+    int ret = 0;
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    if (fwrite(hdr, sizeof(*hdr), 1, file) != 1 ||
+        fwrite(counts, sizeof(uint64_t) * 16 * 256, 1, file) != 1 ||
+        fwrite(ranges, sizeof(*ranges), hdr->nranges, file) != hdr->nranges ||
+        fwrite(samples, sizeof(*samples), hdr->nsamples, file) != hdr->nsamples) {
+        ret = 1;
+    }
+    if (fclose(file) != 0) {
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,60 @@
+/**
+ * \file histfile.h
+ *
+ * \brief Histogram shards of a simulated campaign
+ *
+ * A shard keeps the 16x256 byte counts of the ciphertexts of one or more
+ * ranges of the plaintext stream, instead of the ciphertexts themselves.
+ * Layout, little-endian: a 64-byte header, the counts as uint64_t[16][256],
+ * `nranges` ranges of block indices and `nsamples` ciphertexts with their
+ * block index, which keyrecovery.py re-encrypts to check a candidate key.
+ * Shards of the same campaign are summed by mergeshards.py.
+ */
+
+#ifndef HISTFILE_H
+#define HISTFILE_H
+
+#include <stdint.h>
+
+#define HIST_MAGIC   "PFAHIST"
+#define HIST_VERSION 1
+#define HIST_SAMPLES 4          // ciphertexts kept by the simulator
+
+struct hist_header {
+    char magic[8];              // HIST_MAGIC, NUL-terminated
+    uint32_t version;           // HIST_VERSION
+    uint32_t fault_model;       // enum fault_model of the simulator
+    int32_t fault_location;     // faulted index, -1 for no fault
+    uint32_t fault_op;          // enum skip_op of the simulator
+    uint32_t key_id;            // index of the key in the campaign
+    uint32_t nranges;
+    uint32_t nsamples;
+    uint32_t reserved;
+    uint64_t seed;              // seed of the plaintext stream
+    uint64_t count;             // ciphertexts counted, the sum of the ranges
+    uint8_t pad[8];
+};
+
+struct hist_range {
+    uint64_t first;             // index of the first block in the stream
+    uint64_t count;
+};
+
+struct hist_sample {
+    uint64_t index;             // block index in the stream
+    uint8_t cpt[16];
+};
+
+/*
+ * Whether `path` names a shard (".hist" extension)
+ */
+int hist_is_shard_path(const char *path);
+
+/*
+ * Write a shard; hdr->nranges and hdr->nsamples give the lengths of
+ * `ranges` and `samples`. Returns 0 on success.
+ */
+int hist_write(const char *path, const struct hist_header *hdr, const uint64_t counts[16][256],
+               const struct hist_range *ranges, const struct hist_sample *samples);
+
+#endif /* HISTFILE_H */
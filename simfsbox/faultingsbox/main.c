@@ -12,21 +12,53 @@
  *  http://csrc.nist.gov/publications/fips/fips197/fips-197.pdf
  */
 
-/**
- * Comment this macro to disable the fault
- */
-#define INJECT_FAULT
-
-#ifdef INJECT_FAULT
-int fault_location;
-#endif
-
 #include "common.h"
 #include "aes.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "prng.h"
+#include "cptsfile.h"
+#include "histfile.h"
+#include "pfa.h"
+#include "aes_batch.h"
+#include "sim.h"
+
+#define MAX_THREADS 256
+
+/**
+ * Fault models, selected at runtime with --model
+ */
+enum fault_model {
+    FAULT_MODEL_NONE = 0,   // clean tables
+    FAULT_MODEL_FIXED,      // skip at the S-box index given with --location
+    FAULT_MODEL_RANDOM,     // skip at a random index used by the key schedule
+    FAULT_MODEL_SWEEP       // one run per S-box index 1..255, 0..255 per key with --online
+};
+
+/**
+ * Steps of the affine map in the S-box loop of aes_gen_tables()
+ * that a fault can skip
+ */
+enum skip_op {
+    SKIP_XOR_1 = 1,         // first  `x ^= y`
+    SKIP_XOR_2,             // second `x ^= y`
+    SKIP_XOR_3,             // third  `x ^= y`
+    SKIP_XOR_CONST          // `x ^= y ^ 0x63`
+};
+
+/**
+ * S-box index whose `fault_op` step is skipped in aes_gen_tables(),
+ * or -1 for a fault-free table set
+ */
+int fault_location = -1;
+enum skip_op fault_op = SKIP_XOR_CONST;
 
 /*
  * Forward S-box & tables
@@ -69,28 +101,6 @@ MBEDTLS_MAYBE_UNUSED static void aes_gen_tables(void)
     uint8_t log[256];
 
 
-#ifdef INJECT_FAULT
-    // This is to ensure that the fault affects the key schedule
-    // because these s-box elements are accessed in the key schedule
-    // (with the fixed key under test).
-    uint8_t used_sboxes[37] = {0x00, 0x01, 0x02, 0x92, 0x1b, 0xa0, 0x23, 
-                               0xa7, 0x27, 0xab, 0x2b, 0xae, 0xaf, 0x31, 
-                               0xb4, 0xbe, 0x44, 0x45, 0x48, 0x49, 0x4a, 
-                               0x4d, 0x52, 0x55, 0xdd, 0x60, 0xe0, 0xe2, 
-                               0xe9, 0xec, 0x75, 0x76, 0xf7, 0x79, 0xfb, 
-                               0xfc, 0xfe};
-    int is_fault_keyschedule = 0;
-    do {
-        fault_location = (rand()%255) + 1;
-        for (i = 0; i < 37; i++){
-            if (fault_location == used_sboxes[i]){
-                is_fault_keyschedule = 1;
-                break;
-            }
-        }
-    } while (!is_fault_keyschedule);
-#endif
-
     /*
      * compute pow and log tables over GF(2^8)
      */
@@ -120,13 +130,20 @@ MBEDTLS_MAYBE_UNUSED static void aes_gen_tables(void)
         x = pow[255 - log[i]];
 
         y  = x; y = (y << 1) | (y >> 7);
-        x ^= y; y = (y << 1) | (y >> 7);
-        x ^= y; y = (y << 1) | (y >> 7);
-        x ^= y; y = (y << 1) | (y >> 7);
-#if defined(INJECT_FAULT)
-        if (i==fault_location){} // skip instruction
+        if (i==fault_location && fault_op==SKIP_XOR_1){} // skip instruction
+        else
+        x ^= y;
+        y = (y << 1) | (y >> 7);
+        if (i==fault_location && fault_op==SKIP_XOR_2){} // skip instruction
+        else
+        x ^= y;
+        y = (y << 1) | (y >> 7);
+        if (i==fault_location && fault_op==SKIP_XOR_3){} // skip instruction
+        else
+        x ^= y;
+        y = (y << 1) | (y >> 7);
+        if (i==fault_location && fault_op==SKIP_XOR_CONST){} // skip instruction
         else
-#endif
         x ^= y ^ 0x63;
 
         FSb[i] = x;
@@ -171,8 +188,181 @@ MBEDTLS_MAYBE_UNUSED static void aes_gen_tables(void)
     }
 }
 
+/*
+ * Fault descriptor: the `op` step of the S-box loop is skipped at `location`
+ */
+struct table_fault {
+    int location;           // S-box index in [1,255], -1 for none
+    enum skip_op op;
+};
+
+/*
+ * Entries overwritten by aes_patch_tables(), restored by aes_undo_tables()
+ */
+struct table_patch {
+    int location;           // -1 if nothing was patched
+    unsigned char fsb;
+    uint32_t ft[4];
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+    int rindex;             // RSb index whose entry was overwritten
+    unsigned char rsb;
+    uint32_t rt[4];
+#endif
+};
+
+#if !defined(SIM_LIBRARY)
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    uint8_t r = 0;
+
+    while (b) {
+        if (b & 1) r ^= a;
+        a = (uint8_t) XTIME(a);
+        b >>= 1;
+    }
+    return r;
+}
+
+/*
+ * FSb[i] as computed by the S-box loop of aes_gen_tables() when step `op`
+ * is skipped (0: none), for i in [1,255]
+ */
+static uint8_t aes_sbox_entry(int i, int op)
+{
+    uint8_t x = 1, y, sq = (uint8_t) i;
+    int e;
+
+    // x = i^254, the inverse of i in GF(2^8)
+    for (e = 254; e; e >>= 1) {
+        if (e & 1) x = gf_mul(x, sq);
+        sq = gf_mul(sq, sq);
+    }
+
+    y  = x; y = (uint8_t) ((y << 1) | (y >> 7));
+    if (op != SKIP_XOR_1) x ^= y;
+    y = (uint8_t) ((y << 1) | (y >> 7));
+    if (op != SKIP_XOR_2) x ^= y;
+    y = (uint8_t) ((y << 1) | (y >> 7));
+    if (op != SKIP_XOR_3) x ^= y;
+    y = (uint8_t) ((y << 1) | (y >> 7));
+    if (op != SKIP_XOR_CONST) x ^= y ^ 0x63;
+    return x;
+}
+
+/*
+ * Apply `fault` to fault-free tables by rewriting the one FSb entry it
+ * changes and the entries derived from it, saving them into `undo`. The
+ * result is the table set aes_gen_tables() builds for the same fault.
+ */
+static void aes_patch_tables(const struct table_fault *fault, struct table_patch *undo)
+{
+    int i = fault->location;
+    uint8_t x, y, z;
+
+    undo->location = -1;
+    if (i < 1 || i > 255) {
+        return;
+    }
+
+    undo->location = i;
+    undo->fsb = FSb[i];
+    undo->ft[0] = FT0[i];
+    undo->ft[1] = FT1[i];
+    undo->ft[2] = FT2[i];
+    undo->ft[3] = FT3[i];
+
+    x = aes_sbox_entry(i, fault->op);
+    y = (uint8_t) XTIME(x);
+    z = y ^ x;
+    FSb[i] = x;
+    FT0[i] = ((uint32_t) y) ^
+             ((uint32_t) x <<  8) ^
+             ((uint32_t) x << 16) ^
+             ((uint32_t) z << 24);
+    FT1[i] = ROTL8(FT0[i]);
+    FT2[i] = ROTL8(FT1[i]);
+    FT3[i] = ROTL8(FT2[i]);
+
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+    // The faulty value x is also FSb[j] of some j != i; the loop of
+    // aes_gen_tables() leaves RSb[x] to the later of i and j
+    undo->rindex = x;
+    undo->rsb = RSb[x];
+    undo->rt[0] = RT0[x];
+    undo->rt[1] = RT1[x];
+    undo->rt[2] = RT2[x];
+    undo->rt[3] = RT3[x];
+    if (i > RSb[x]) {
+        RSb[x] = (unsigned char) i;
+        RT0[x] = ((uint32_t) gf_mul(0x0E, (uint8_t) i)) ^
+                 ((uint32_t) gf_mul(0x09, (uint8_t) i) <<  8) ^
+                 ((uint32_t) gf_mul(0x0D, (uint8_t) i) << 16) ^
+                 ((uint32_t) gf_mul(0x0B, (uint8_t) i) << 24);
+        RT1[x] = ROTL8(RT0[x]);
+        RT2[x] = ROTL8(RT1[x]);
+        RT3[x] = ROTL8(RT2[x]);
+    }
+#endif
+
+    fault_location = i;
+    fault_op = fault->op;
+}
+
+/*
+ * Restore the entries saved by aes_patch_tables()
+ */
+static void aes_undo_tables(const struct table_patch *undo)
+{
+    int i = undo->location;
+
+    if (i < 0) {
+        return;
+    }
+
+    FSb[i] = undo->fsb;
+    FT0[i] = undo->ft[0];
+    FT1[i] = undo->ft[1];
+    FT2[i] = undo->ft[2];
+    FT3[i] = undo->ft[3];
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+    RSb[undo->rindex] = undo->rsb;
+    RT0[undo->rindex] = undo->rt[0];
+    RT1[undo->rindex] = undo->rt[1];
+    RT2[undo->rindex] = undo->rt[2];
+    RT3[undo->rindex] = undo->rt[3];
+#endif
+    fault_location = -1;
+}
+#endif /* !SIM_LIBRARY */
+
 #undef ROTL8
 
+/*
+ * Regenerate the tables with the skip at `location` (-1: no fault)
+ */
+static void aes_regen_tables(int location)
+{
+    fault_location = location;
+    aes_gen_tables();
+    aes_init_done = 1;
+}
+
+#if !defined(SIM_LIBRARY)
+/*
+ * Draw a fault location that affects the key schedule, i.e. an index set in
+ * the map of pfa_key_schedule_entries() (index 0 is never hit by the skip)
+ */
+static int pick_keyschedule_fault_location(const uint8_t used[32])
+{
+    int location;
+
+    do {
+        location = (rand()%255) + 1;
+    } while (!pfa_entry_used(used, location));
+    return location;
+}
+#endif /* !SIM_LIBRARY */
+
 #define AES_RT0(idx) RT0[idx]
 #define AES_RT1(idx) RT1[idx]
 #define AES_RT2(idx) RT2[idx]
@@ -649,6 +839,7 @@ exit:
 }
 #endif /* MBEDTLS_CIPHER_MODE_CBC */
 
+#if !defined(SIM_LIBRARY)
 static const unsigned char aes_test_ecb_enc[][16] =
 {
     { 0xC3, 0x4C, 0x05, 0x2C, 0xC0, 0xDA, 0x8D, 0x73,
@@ -740,6 +931,112 @@ int self_test_cbc128_enc()
     return ret;
 }
 
+/*
+ * Check that aes_patch_tables() gives the tables of aes_gen_tables() at every
+ * location and that aes_undo_tables() restores the clean ones
+ */
+int self_test_table_patch()
+{
+    static unsigned char fsb[2][256];
+    static uint32_t ft[2][4][256];
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+    static unsigned char rsb[2][256];
+    static uint32_t rt[2][256];
+#endif
+    struct table_patch patch;
+    int ret = 0, location, t;
+
+    memcpy(fsb[0], FSb, 256);
+    memcpy(ft[0][0], FT0, sizeof(FT0));
+    memcpy(ft[0][1], FT1, sizeof(FT1));
+    memcpy(ft[0][2], FT2, sizeof(FT2));
+    memcpy(ft[0][3], FT3, sizeof(FT3));
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+    memcpy(rsb[0], RSb, 256);
+    memcpy(rt[0], RT0, sizeof(RT0));
+#endif
+
+    for (location = 1; location < 256 && ret == 0; location++) {
+        struct table_fault fault = {location, fault_op};
+
+        aes_regen_tables(location);
+        memcpy(fsb[1], FSb, 256);
+        memcpy(ft[1][0], FT0, sizeof(FT0));
+        memcpy(ft[1][1], FT1, sizeof(FT1));
+        memcpy(ft[1][2], FT2, sizeof(FT2));
+        memcpy(ft[1][3], FT3, sizeof(FT3));
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+        memcpy(rsb[1], RSb, 256);
+        memcpy(rt[1], RT0, sizeof(RT0));
+#endif
+        aes_regen_tables(-1);
+
+        for (t = 1; t >= 0 && ret == 0; t--) {
+            if (t == 1) aes_patch_tables(&fault, &patch);
+            else aes_undo_tables(&patch);
+            if (memcmp(fsb[t], FSb, 256) != 0 ||
+                memcmp(ft[t][0], FT0, sizeof(FT0)) != 0 || memcmp(ft[t][1], FT1, sizeof(FT1)) != 0 ||
+                memcmp(ft[t][2], FT2, sizeof(FT2)) != 0 || memcmp(ft[t][3], FT3, sizeof(FT3)) != 0) {
+                ret = 1;
+            }
+#if defined(MBEDTLS_AES_NEED_REVERSE_TABLES)
+            if (memcmp(rsb[t], RSb, 256) != 0 || memcmp(rt[t], RT0, sizeof(RT0)) != 0) {
+                ret = 1;
+            }
+#endif
+            if (ret != 0) {
+                printf("[FAILED] Table %s at fault location %02x!\n",
+                       t ? "patch" : "undo", location);
+            }
+        }
+    }
+    if (ret == 0) {
+        printf("[PASSED] Table patch and undo at every fault location!\n");
+    }
+    aes_regen_tables(-1);
+    return ret;
+}
+
+/*
+ * Check aes_batch_encrypt() against mbedtls_aes_crypt_ecb() with the tables
+ * faulted at `location` (-1 for none); the clean tables are restored after
+ */
+int self_test_batch_enc(int location)
+{
+    int ret = 0, i;
+    unsigned char key[16];
+    unsigned char ref[37 * 16];
+    unsigned char buf[37 * 16];
+
+    mbedtls_aes_context ctx;
+    struct table_fault fault = {location, fault_op};
+    struct table_patch patch;
+    aes_patch_tables(&fault, &patch);
+    mbedtls_aes_init(&ctx);
+    for (i=0; i<16; i++) key[i] = (unsigned char) (17 * i + 1);
+    mbedtls_aes_setkey_enc(&ctx, key, 128);
+
+    // An odd block count exercises the partial batches too
+    for (i=0; i<37; i++){
+        prng_block(0, i, buf + 16 * i);
+        mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, buf + 16 * i, ref + 16 * i);
+    }
+    aes_batch_encrypt(&ctx, FSb, buf, buf, 37);
+
+    if (memcmp(buf, ref, sizeof(ref)) != 0) {
+        ret = 1;
+        printf("[FAILED] Batch encryption (%s) with fault location %d!\n",
+               aes_batch_backend_for(FSb), location);
+    }
+    else {
+        printf("[PASSED] Batch encryption (%s) with fault location %d!\n",
+               aes_batch_backend_for(FSb), location);
+    }
+    mbedtls_aes_free(&ctx);
+    aes_undo_tables(&patch);
+    return ret;
+}
+
 // S-box reference
 static const unsigned char RFSb[256] =
 {
@@ -777,66 +1074,761 @@ static const unsigned char RFSb[256] =
     0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
 };
 
-int main(int argc, char *argv[])
+static void print_sbox(const unsigned char *sbox)
 {
-    srand(time(NULL));
-    self_test_ecb128_enc();
-    self_test_cbc128_enc();
-
     int i, j;
 
-#ifdef INJECT_FAULT
-    printf("Fault location: %02x = (%d, %d)\n", fault_location, fault_location/16, fault_location%16);
-    printf("Faulted S-box:\n");
     printf("    ");
     for (j = 0; j < 16; j++) printf("%2d ", j); printf("\n");
     for (j = 0; j < 17; j++) printf("---"); printf("\n");
     for (i = 0; i < 16; i++){
         printf("%2d| ", i);
-        for (int j = 0; j < 16; j++) printf("%02x ", FSb[i*16+j]);
+        for (j = 0; j < 16; j++) printf("%02x ", sbox[i*16+j]);
         printf("\n");
     }
+}
 
-    printf("Reference S-box:\n");
-    printf("    ");
-    for (j = 0; j < 16; j++) printf("%2d ", j); printf("\n");
-    for (j = 0; j < 17; j++) printf("---"); printf("\n");
-    for (i = 0; i < 16; i++){
-        printf("%2d| ", i);
-        for (int j = 0; j < 16; j++) printf("%02x ", RFSb[i*16+j]);
-        printf("\n");
+#endif /* !SIM_LIBRARY */
+
+/*
+ * Ciphertexts are produced in chunks of CHUNK_BLOCKS blocks, each chunk split
+ * across the worker threads. Text output is formatted as fixed-width hex lines
+ * and written out per chunk; binary output goes straight into the mapped file;
+ * a histogram shard only keeps per-thread byte counts.
+ */
+#define CHUNK_BLOCKS (1u << 18)
+#define LINE_LEN     33     // 32 hex digits and '\n'
+#define BATCH_BLOCKS 64     // blocks per aes_batch_encrypt() call in a worker
+
+#if !defined(SIM_LIBRARY)
+struct gen_job {
+    const unsigned char *key;
+    uint64_t seed;
+    uint64_t first;         // campaign index of the first block
+    size_t count;
+    int binary;
+    unsigned char *out;     // count * 16 bytes (binary) or count * LINE_LEN bytes
+    uint64_t (*counts)[256];    // byte counts of the thread for a shard, else NULL
+    int ret;
+};
+
+static void *gen_worker(void *arg)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    struct gen_job *job = arg;
+    unsigned char buf[BATCH_BLOCKS * 16];
+    mbedtls_aes_context ctx;
+    size_t i, k, count;
+    int j;
+
+    mbedtls_aes_init(&ctx);
+    job->ret = mbedtls_aes_setkey_enc(&ctx, job->key, 128);
+
+    for (i = 0; i < job->count && job->ret == 0; i += count){
+        unsigned char *blocks = job->binary ? job->out + i * 16 : buf;
+
+        count = (job->count - i < BATCH_BLOCKS) ? job->count - i : BATCH_BLOCKS;
+        for (k = 0; k < count; k++) {
+            prng_block(job->seed, job->first + i + k, blocks + k * 16);
+        }
+        aes_batch_encrypt(&ctx, FSb, blocks, blocks, count);
+        if (job->counts != NULL) {
+            for (k = 0; k < count * 16; k++) {
+                job->counts[k & 15][blocks[k]]++;
+            }
+            continue;
+        }
+        if (job->binary) {
+            continue;
+        }
+        for (k = 0; k < count; k++) {
+            unsigned char *line = job->out + (i + k) * LINE_LEN;
+
+            for (j = 0; j < 16; j++){
+                line[2*j]   = hex[buf[16*k+j] >> 4];
+                line[2*j+1] = hex[buf[16*k+j] & 0xF];
+            }
+            line[32] = '\n';
+        }
     }
-#endif
 
-    FILE *file = fopen("cpts.txt", "w");
-    if (file == NULL){
-        printf("Failed to open file");
+    mbedtls_aes_free(&ctx);
+    return NULL;
+}
+
+/*
+ * Write the byte counts of blocks first..first+N-1, summed over the threads,
+ * and their first ciphertexts into the shard `path`
+ */
+static int write_shard(const char *path, const unsigned char key[16], uint64_t first, uint64_t N,
+                       uint64_t seed, enum fault_model model, uint64_t (*counts)[16][256], int threads)
+{
+    struct hist_header hdr;
+    struct hist_range range = {first, N};
+    struct hist_sample samples[HIST_SAMPLES];
+    unsigned char blocks[HIST_SAMPLES * 16];
+    mbedtls_aes_context ctx;
+    int t, i, j;
+
+    for (t = 1; t < threads; t++) {
+        for (i = 0; i < 16; i++) {
+            for (j = 0; j < 256; j++) counts[0][i][j] += counts[t][i][j];
+        }
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HIST_MAGIC, sizeof(HIST_MAGIC));
+    hdr.version = HIST_VERSION;
+    hdr.fault_model = (uint32_t) model;
+    hdr.fault_location = fault_location;
+    hdr.fault_op = (uint32_t) fault_op;
+    hdr.key_id = 0;
+    hdr.nranges = N > 0;
+    hdr.nsamples = (N < HIST_SAMPLES) ? (uint32_t) N : HIST_SAMPLES;
+    hdr.seed = seed;
+    hdr.count = N;
+
+    mbedtls_aes_init(&ctx);
+    mbedtls_aes_setkey_enc(&ctx, key, 128);
+    for (i = 0; i < (int) hdr.nsamples; i++) {
+        prng_block(seed, first + i, blocks + 16 * i);
+    }
+    aes_batch_encrypt(&ctx, FSb, blocks, blocks, hdr.nsamples);
+    mbedtls_aes_free(&ctx);
+    for (i = 0; i < (int) hdr.nsamples; i++) {
+        samples[i].index = first + i;
+        memcpy(samples[i].cpt, blocks + 16 * i, 16);
+    }
+
+    if (hist_write(path, &hdr, (const uint64_t (*)[256]) counts[0], &range, samples) != 0) {
+        printf("Failed to write file %s\n", path);
         return 1;
     }
+    return 0;
+}
 
-    // Number of encryptions
-    unsigned int N = 5000;
-    unsigned char key[16] = {0x5b, 0x12, 0xa4, 0x7f, 0x2b, 0x55, 0x71, 0x19, 
-                             0x1e, 0xc0, 0x6d, 0x7c, 0x02, 0xfc, 0x60, 0x76};
-    int ret = 0, mode=MBEDTLS_AES_ENCRYPT;
-    unsigned int keybits = 128;
-    unsigned char buf[16];
+/*
+ * Encrypt N random plaintexts, blocks first..first+N-1 of the stream of
+ * `seed`, under the current tables on `threads` threads and write the
+ * ciphertexts into `path`: a binary container (see cptsfile.h) if it ends
+ * with ".bin", a histogram shard (see histfile.h) if it ends with ".hist",
+ * one hex line per block otherwise
+ */
+static int collect_ciphertexts(const unsigned char key[16], uint64_t first, uint64_t N,
+                               uint64_t seed, int threads, const char *path,
+                               enum fault_model model)
+{
+    struct gen_job jobs[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    int binary = cpts_is_binary_path(path);
+    int shard = hist_is_shard_path(path);
+    struct cpts_map map = {NULL, 0};
+    unsigned char *records = NULL, *out = NULL;
+    uint64_t (*counts)[16][256] = NULL;
+    FILE *file = NULL;
+    uint64_t done;
+    int t, ret = 0;
+
+    if (shard) {
+        counts = calloc((size_t) threads, sizeof(*counts));
+        if (counts == NULL) {
+            printf("Failed to allocate the byte counts\n");
+            return 1;
+        }
+    } else if (binary) {
+        struct cpts_header hdr;
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, CPTS_MAGIC, sizeof(CPTS_MAGIC));
+        hdr.version = CPTS_VERSION;
+        hdr.record_size = CPTS_RECORD_SIZE;
+        hdr.fault_model = (uint32_t) model;
+        hdr.fault_location = fault_location;
+        hdr.key_id = 0;
+        hdr.seed = seed;
+        hdr.count = N;
+
+        records = cpts_create(path, &hdr, &map);
+        if (records == NULL) {
+            printf("Failed to create file %s\n", path);
+            return 1;
+        }
+    } else {
+        file = fopen(path, "w");
+        if (file == NULL){
+            printf("Failed to open file %s\n", path);
+            return 1;
+        }
+
+        out = malloc((size_t) CHUNK_BLOCKS * LINE_LEN);
+        if (out == NULL) {
+            printf("Failed to allocate the output buffer\n");
+            fclose(file);
+            return 1;
+        }
+    }
+
+    for (done = 0; done < N && ret == 0; ) {
+        size_t chunk = (N - done < CHUNK_BLOCKS) ? (size_t) (N - done) : CHUNK_BLOCKS;
+        size_t share = (chunk + threads - 1) / threads;
+        size_t offset = 0;
+        int spawned = 0;
+
+        for (t = 0; t < threads && offset < chunk; t++, spawned++) {
+            jobs[t].key = key;
+            jobs[t].seed = seed;
+            jobs[t].first = first + done + offset;
+            jobs[t].count = (chunk - offset < share) ? chunk - offset : share;
+            jobs[t].binary = binary;
+            jobs[t].out = shard  ? NULL
+                        : binary ? records + (done + offset) * CPTS_RECORD_SIZE
+                                 : out + offset * LINE_LEN;
+            jobs[t].counts = shard ? counts[t] : NULL;
+            offset += jobs[t].count;
+            pthread_create(&tids[t], NULL, gen_worker, &jobs[t]);
+        }
+        for (t = 0; t < spawned; t++) {
+            pthread_join(tids[t], NULL);
+            if (jobs[t].ret != 0) {
+                printf("[FAILED] ECB encryption!\n");
+                ret = jobs[t].ret;
+            }
+        }
+
+        if (ret == 0 && !binary && !shard && fwrite(out, LINE_LEN, chunk, file) != chunk) {
+            printf("Failed to write file %s\n", path);
+            ret = 1;
+        }
+        done += chunk;
+    }
+
+    if (shard) {
+        if (ret == 0) ret = write_shard(path, key, first, N, seed, model, counts, threads);
+        free(counts);
+    } else if (binary) {
+        cpts_close(&map);
+    } else {
+        free(out);
+        fclose(file);
+    }
+    return ret;
+}
+
+/*
+ * Encrypt up to N random plaintexts under the current tables, counting the
+ * ciphertexts into the PFA histograms every `check_every` blocks until the
+ * recovery decision has been stable for `patience` checks. Nothing is written.
+ */
+static int online_recovery(const unsigned char key[16], uint64_t N, uint64_t seed,
+                           int check_every, int patience, struct pfa_result *res)
+{
+    struct pfa_state st;
     mbedtls_aes_context ctx;
+    unsigned char *buf;
+    int ret = 0;
+
+    buf = malloc((size_t) check_every * 16);
+    if (buf == NULL) {
+        printf("Failed to allocate the encryption buffer\n");
+        return 1;
+    }
+
+    pfa_init(&st);
     mbedtls_aes_init(&ctx);
-    mbedtls_aes_setkey_enc(&ctx, key, keybits);
+    ret = mbedtls_aes_setkey_enc(&ctx, key, 128);
 
-    
-    for (i = 0; i < N; i++){
-        for (j = 0; j < 16; j++) buf[j] = rand() % 256;
-        ret = mbedtls_aes_crypt_ecb(&ctx, mode, buf, buf);
-        if (ret != 0) {
-            printf("[FAILED] ECB encryption!\n");
-            return ret;
+    memset(res, 0, sizeof(*res));
+    res->f = -1;
+    res->location = -1;
+
+    while (st.n < N && ret == 0) {
+        uint64_t count = (N - st.n < (uint64_t) check_every) ? N - st.n : (uint64_t) check_every;
+        uint64_t i;
+
+        for (i = 0; i < count; i++) {
+            prng_block(seed, st.n + i, buf + i * 16);
+        }
+        aes_batch_encrypt(&ctx, FSb, buf, buf, (size_t) count);
+        pfa_update(&st, buf, (size_t) count);
+
+        if (pfa_check(&st, patience)) {
+            res->decided = 1;
+            break;
         }
-        for (j = 0; j < 16; j++) fprintf(file, "%02X", buf[j]); fprintf(file, "\n");
     }
 
-    fclose(file);
+    res->n = st.n;
+    if (res->decided) {
+        res->f = st.f;
+        res->location = pfa_recover(&st, RFSb, key);
+        res->recovered = res->location >= 0;
+    }
+
+    mbedtls_aes_free(&ctx);
+    free(buf);
+    return ret;
+}
+
+#endif /* !SIM_LIBRARY */
 
+/*
+ * Shared-library interface (sim.h): `make libsim.so` builds this file with
+ * -DSIM_LIBRARY, without main(), for simlib.py. The tables are global, so a
+ * process simulates one fault at a time. Every buffer belongs to the caller.
+ */
+size_t sim_context_size(void)
+{
+    return sizeof(mbedtls_aes_context);
+}
+
+/*
+ * Regenerate the tables with step `op` skipped at S-box index `location`
+ * (-1: no fault). Contexts set up before keep the round keys of the old S-box.
+ */
+int sim_set_fault(int location, int op)
+{
+    if (location < -1 || location > 255 || op < SKIP_XOR_1 || op > SKIP_XOR_CONST) {
+        return -1;
+    }
+    fault_op = (enum skip_op) op;
+    aes_regen_tables(location);
     return 0;
-}
\ No newline at end of file
+}
+
+void sim_get_sbox(unsigned char sbox[256])
+{
+    memcpy(sbox, FSb, 256);
+}
+
+/*
+ * Key schedule of `key` under the current (faulted) S-box into `ctx`, a
+ * buffer of sim_context_size() bytes
+ */
+int sim_setkey(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    mbedtls_aes_init(ctx);
+    return mbedtls_aes_setkey_enc(ctx, key, keybits);
+}
+
+/*
+ * Round keys of `ctx` as 4 * (nr + 1) little-endian words; returns nr
+ */
+int sim_round_keys(const mbedtls_aes_context *ctx, uint32_t *rk)
+{
+    memcpy(rk, ctx->buf + ctx->rk_offset, sizeof(uint32_t) * 4 * (ctx->nr + 1));
+    return ctx->nr;
+}
+
+/*
+ * Plaintexts first..first+n-1 of the stream of `seed`, as main -s seed
+ */
+void sim_plaintexts(uint64_t seed, uint64_t first, unsigned char *pts, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        prng_block(seed, first + i, pts + 16 * i);
+    }
+}
+
+void sim_encrypt(const mbedtls_aes_context *ctx, const unsigned char *pts, unsigned char *cpts,
+                 size_t n)
+{
+    aes_batch_encrypt(ctx, FSb, pts, cpts, n);
+}
+
+/*
+ * Add the byte counts of the ciphertexts of plaintexts first..first+n-1 of
+ * the stream of `seed` to `counts`, without storing the ciphertexts
+ */
+void sim_count(const mbedtls_aes_context *ctx, uint64_t seed, uint64_t first, uint64_t n,
+               uint64_t counts[16][256])
+{
+    unsigned char buf[BATCH_BLOCKS * 16];
+    uint64_t i, k, count;
+
+    for (i = 0; i < n; i += count) {
+        count = (n - i < BATCH_BLOCKS) ? n - i : BATCH_BLOCKS;
+        sim_plaintexts(seed, first + i, buf, (size_t) count);
+        aes_batch_encrypt(ctx, FSb, buf, buf, (size_t) count);
+        for (k = 0; k < count * 16; k++) {
+            counts[k & 15][buf[k]]++;
+        }
+    }
+}
+
+#if !defined(SIM_LIBRARY)
+static void print_online_result(int location, const struct pfa_result *res)
+{
+    if (location < 0) printf("No fault: ");
+    else printf("Fault location %02x: ", location);
+
+    if (!res->decided) {
+        printf("no stable decision after %llu ciphertexts\n", (unsigned long long) res->n);
+    } else {
+        printf("stable after %llu ciphertexts, f = %02x, key %s",
+               (unsigned long long) res->n, res->f,
+               res->recovered ? "recovered" : "NOT recovered");
+        if (res->recovered) printf(" (faulty S-box entry %02x)", res->location);
+        printf("\n");
+    }
+}
+
+/*
+ * Exhaustive online sweep: every S-box index 0..255 (0 is never hit by the
+ * skip) against `keys` keys. Key 0 is the reference key, the others are drawn
+ * from the seed. The tables are global, so the runs are spread over forked
+ * worker processes, which take the next (location, key) pair from a counter
+ * in a shared mapping and store their result next to it. With
+ * `keyschedule_only`, the pairs whose index is not read by the key schedule
+ * of the key are skipped.
+ */
+#define SWEEP_LOCATIONS  256
+#define SWEEP_KEY_STREAM 0x4B455953ULL    // "KEYS", keeps the keys apart from the plaintexts
+
+struct sweep_table {
+    uint64_t next;                  // next run to take, updated atomically
+    struct pfa_result res[];        // SWEEP_LOCATIONS * keys runs, location-major
+};
+
+struct sweep_keys {
+    int count;
+    int keyschedule_only;
+    unsigned char (*key)[16];
+    uint8_t (*used)[32];            // pfa_key_schedule_entries() of each key
+};
+
+static void sweep_key(const unsigned char ref_key[16], uint64_t seed, int k,
+                      unsigned char key[16])
+{
+    if (k == 0) memcpy(key, ref_key, 16);
+    else prng_block(seed ^ SWEEP_KEY_STREAM, (uint64_t) k, key);
+}
+
+static void sweep_worker(struct sweep_table *table, const struct sweep_keys *keys,
+                         uint64_t N, uint64_t seed, int check_every, int patience)
+{
+    uint64_t total = (uint64_t) SWEEP_LOCATIONS * keys->count, run;
+    struct table_patch patch = { .location = -1 };
+    int current = -2;
+
+    while ((run = __atomic_fetch_add(&table->next, 1, __ATOMIC_RELAXED)) < total) {
+        int location = (int) (run / keys->count), k = (int) (run % keys->count);
+
+        // Index 0 is read by every key schedule but never hit by the skip
+        if (keys->keyschedule_only && (location == 0 || !pfa_entry_used(keys->used[k], location))) {
+            continue;
+        }
+        if (location != current) {
+            struct table_fault fault = {location, fault_op};
+
+            aes_undo_tables(&patch);
+            aes_patch_tables(&fault, &patch);
+            current = location;
+        }
+        // Run k encrypts the plaintexts of seed + k at every location
+        if (online_recovery(keys->key[k], N, seed + k, check_every, patience,
+                            &table->res[run]) != 0) {
+            table->res[run].decided = -1;
+        }
+    }
+}
+
+static int run_sweep(const unsigned char ref_key[16], int keys, int keyschedule_only,
+                     uint64_t N, uint64_t seed, int workers, int check_every, int patience,
+                     const char *path)
+{
+    size_t size = sizeof(struct sweep_table) +
+                  (size_t) SWEEP_LOCATIONS * keys * sizeof(struct pfa_result);
+    struct sweep_table *table;
+    struct sweep_keys ks;
+    pid_t pids[MAX_THREADS];
+    FILE *file;
+    int w, location, k, ret = 0, recovered = 0, runs = 0;
+
+    ks.count = keys;
+    ks.keyschedule_only = keyschedule_only;
+    ks.key = malloc((size_t) keys * sizeof(*ks.key));
+    ks.used = malloc((size_t) keys * sizeof(*ks.used));
+    if (ks.key == NULL || ks.used == NULL) {
+        printf("Failed to allocate the sweep keys\n");
+        free(ks.key);
+        free(ks.used);
+        return 1;
+    }
+    // The used S-box entries are those of the fault-free key schedule
+    for (k = 0; k < keys; k++) {
+        sweep_key(ref_key, seed, k, ks.key[k]);
+        pfa_key_schedule_entries(RFSb, ks.key[k], ks.used[k]);
+    }
+
+    table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        printf("Failed to map the sweep table\n");
+        free(ks.key);
+        free(ks.used);
+        return 1;
+    }
+    memset(table, 0, size);
+
+    fflush(stdout);
+    for (w = 0; w < workers; w++) {
+        pids[w] = fork();
+        if (pids[w] < 0) {
+            printf("Failed to start sweep worker %d\n", w);
+            ret = 1;
+            break;
+        }
+        if (pids[w] == 0) {
+            sweep_worker(table, &ks, N, seed, check_every, patience);
+            _exit(0);
+        }
+    }
+    while (w-- > 0) {
+        int status;
+
+        if (waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("Sweep worker %d failed\n", w);
+            ret = 1;
+        }
+    }
+    if (ret == 0 && table->next < (uint64_t) SWEEP_LOCATIONS * keys) {
+        printf("Sweep incomplete\n");
+        ret = 1;
+    }
+
+    file = (ret == 0) ? fopen(path, "w") : NULL;
+    if (ret == 0 && file == NULL) {
+        printf("Failed to open file %s\n", path);
+        ret = 1;
+    }
+    if (ret != 0) {
+        munmap(table, size);
+        free(ks.key);
+        free(ks.used);
+        return ret;
+    }
+
+    fprintf(file, "location,key_index,key,key_schedule,decided,recovered,ciphertexts,f,faulty_entry\n");
+    for (location = 0; location < SWEEP_LOCATIONS; location++) {
+        int ok = 0, done = 0;
+        uint64_t sum = 0;
+
+        for (k = 0; k < keys; k++) {
+            const struct pfa_result *res = &table->res[(size_t) location * keys + k];
+            int used = pfa_entry_used(ks.used[k], location);
+
+            if (keyschedule_only && (location == 0 || !used)) continue;
+            if (res->decided < 0) ret = 1;
+            fprintf(file, "%d,%d,", location, k);
+            for (w = 0; w < 16; w++) fprintf(file, "%02x", ks.key[k][w]);
+            fprintf(file, ",%d,%d,%d,%llu,%d,%d\n", used, res->decided, res->recovered,
+                    (unsigned long long) res->n, res->f, res->location);
+            done++;
+            if (res->recovered) {
+                ok++;
+                sum += res->n;
+            }
+        }
+        recovered += ok;
+        runs += done;
+        if (done == 0) continue;
+        printf("Fault location %02x: key recovered for %d/%d keys", location, ok, done);
+        if (ok > 0) printf(", %.0f ciphertexts on average", (double) sum / ok);
+        printf("\n");
+    }
+    fclose(file);
+    munmap(table, size);
+    free(ks.key);
+    free(ks.used);
+
+    printf("Sweep done: %d/%d runs recovered the key, results in %s\n", recovered, runs, path);
+    return ret;
+}
+
+/*
+ * Output path of one sweep run: "cpts.txt" -> "cpts_1b.txt"
+ */
+static void sweep_path(char *buf, size_t size, const char *path, int location)
+{
+    const char *ext = strrchr(path, '.');
+    int stem = (ext != NULL && strchr(ext, '/') == NULL) ? (int) (ext - path) : (int) strlen(path);
+
+    snprintf(buf, size, "%.*s_%02x%s", stem, path, location, path + stem);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -m, --model MODEL     none | fixed | random | sweep (default: random)\n");
+    printf("  -l, --location IDX    S-box index in [1,255] for --model fixed\n");
+    printf("      --skip-op OP      skipped step of the S-box affine map: 1..3 for the\n");
+    printf("                        `x ^= y` steps, 4 for `x ^= y ^ 0x63` (default: 4)\n");
+    printf("  -n, --count N         number of encryptions per run (default: 5000),\n");
+    printf("                        the maximum number with --online\n");
+    printf("  -s, --seed SEED       seed of the plaintexts and fault location (default: time)\n");
+    printf("  -j, --threads T       number of encryption threads (default: 1),\n");
+    printf("                        worker processes for an online sweep\n");
+    printf("  -f, --first I         index of the first plaintext in the stream of the seed\n");
+    printf("                        (default: 0), to split a campaign into .hist shards\n");
+    printf("  -o, --output PATH     ciphertext file (default: cpts.txt), binary if it ends with .bin,\n");
+    printf("                        byte counts only if it ends with .hist;\n");
+    printf("                        a sweep writes one file per index, e.g. cpts_1b.txt;\n");
+    printf("                        an online sweep writes its result table (default: sweep.csv)\n");
+    printf("  -O, --online          recover the key while encrypting and stop once the\n");
+    printf("                        decision is stable, without writing ciphertexts\n");
+    printf("  -k, --keys K          keys per fault location in an online sweep (default: 1)\n");
+    printf("      --keyschedule-only  in an online sweep, only the indices read by the key\n");
+    printf("                        schedule of each key\n");
+    printf("      --check-every K   ciphertexts between two online checks (default: 64)\n");
+    printf("      --patience P      consecutive identical decisions to stop (default: 4)\n");
+    printf("  -h, --help            show this message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    enum fault_model model = FAULT_MODEL_RANDOM;
+    int location = -1;
+    uint64_t N = 5000, first = 0;
+    uint64_t seed = (uint64_t) time(NULL);
+    int threads = 1;
+    const char *output = NULL;
+    int online = 0, check_every = 64, patience = 4, keys = 1, keyschedule_only = 0;
+    uint8_t used[32];
+    int opt, ret = 0;
+    struct pfa_result res;
+    struct table_fault fault;
+    struct table_patch patch;
+
+    static const struct option long_options[] = {
+        {"model",    required_argument, NULL, 'm'},
+        {"location", required_argument, NULL, 'l'},
+        {"count",    required_argument, NULL, 'n'},
+        {"seed",     required_argument, NULL, 's'},
+        {"threads",  required_argument, NULL, 'j'},
+        {"first",    required_argument, NULL, 'f'},
+        {"output",   required_argument, NULL, 'o'},
+        {"online",   no_argument,       NULL, 'O'},
+        {"keys",     required_argument, NULL, 'k'},
+        {"keyschedule-only", no_argument, NULL, 'U'},
+        {"skip-op",  required_argument, NULL, 'X'},
+        {"check-every", required_argument, NULL, 'K'},
+        {"patience", required_argument, NULL, 'P'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "m:l:n:s:j:f:o:Ok:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "none") == 0) model = FAULT_MODEL_NONE;
+                else if (strcmp(optarg, "fixed") == 0) model = FAULT_MODEL_FIXED;
+                else if (strcmp(optarg, "random") == 0) model = FAULT_MODEL_RANDOM;
+                else if (strcmp(optarg, "sweep") == 0) model = FAULT_MODEL_SWEEP;
+                else {
+                    printf("Unknown fault model: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l': location = (int) strtol(optarg, NULL, 0); break;
+            case 'n': N = strtoull(optarg, NULL, 0); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'f': first = strtoull(optarg, NULL, 0); break;
+            case 'o': output = optarg; break;
+            case 'O': online = 1; break;
+            case 'k': keys = atoi(optarg); break;
+            case 'U': keyschedule_only = 1; break;
+            case 'X': fault_op = (enum skip_op) atoi(optarg); break;
+            case 'K': check_every = atoi(optarg); break;
+            case 'P': patience = atoi(optarg); break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (model == FAULT_MODEL_FIXED && (location < 1 || location > 255)) {
+        printf("--model fixed needs --location in [1,255]\n");
+        return 1;
+    }
+    if (threads < 1 || threads > MAX_THREADS) {
+        printf("--threads must be in [1,%d]\n", MAX_THREADS);
+        return 1;
+    }
+    if (check_every < 1 || patience < 1) {
+        printf("--check-every and --patience must be positive\n");
+        return 1;
+    }
+    if (keys < 1 || keys > (1 << 20)) {
+        printf("--keys must be in [1,%d]\n", 1 << 20);
+        return 1;
+    }
+    if (fault_op < SKIP_XOR_1 || fault_op > SKIP_XOR_CONST) {
+        printf("--skip-op must be in [%d,%d]\n", SKIP_XOR_1, SKIP_XOR_CONST);
+        return 1;
+    }
+    fault.op = fault_op;
+
+    // The self-tests only hold for the fault-free tables
+    aes_regen_tables(-1);
+    self_test_ecb128_enc();
+    self_test_cbc128_enc();
+    self_test_table_patch();
+    self_test_batch_enc(-1);
+    self_test_batch_enc(0x49);
+
+    unsigned char key[16] = {0x5b, 0x12, 0xa4, 0x7f, 0x2b, 0x55, 0x71, 0x19, 
+                             0x1e, 0xc0, 0x6d, 0x7c, 0x02, 0xfc, 0x60, 0x76};
+
+    if (model == FAULT_MODEL_SWEEP && online) {
+        return run_sweep(key, keys, keyschedule_only, N, seed, threads, check_every, patience,
+                         output != NULL ? output : "sweep.csv");
+    }
+    if (output == NULL) output = "cpts.txt";
+    if (first != 0 && (online || !hist_is_shard_path(output))) {
+        printf("--first needs a .hist output\n");
+        return 1;
+    }
+
+    if (model == FAULT_MODEL_SWEEP) {
+        char path[4096];
+
+        for (location = 1; location < 256 && ret == 0; location++) {
+            fault.location = location;
+            aes_patch_tables(&fault, &patch);
+            sweep_path(path, sizeof(path), output, location);
+            ret = collect_ciphertexts(key, first, N, seed, threads, path, model);
+            aes_undo_tables(&patch);
+        }
+        if (ret == 0) {
+            printf("Sweep done: %llu ciphertexts for each of 255 fault locations\n", (unsigned long long) N);
+        }
+        return ret;
+    }
+
+    srand((unsigned int) seed);
+    pfa_key_schedule_entries(RFSb, key, used);
+    if (model == FAULT_MODEL_RANDOM) location = pick_keyschedule_fault_location(used);
+    if (model == FAULT_MODEL_NONE) location = -1;
+    fault.location = location;
+    aes_patch_tables(&fault, &patch);
+
+    if (location >= 0) {
+        printf("Fault location: %02x = (%d, %d), %s by the key schedule\n",
+               location, location/16, location%16,
+               pfa_entry_used(used, location) ? "read" : "not read");
+        printf("Faulted S-box:\n");
+        print_sbox(FSb);
+        printf("Reference S-box:\n");
+        print_sbox(RFSb);
+    }
+
+    if (online) {
+        ret = online_recovery(key, N, seed, check_every, patience, &res);
+        print_online_result(location, &res);
+        return ret;
+    }
+
+    return collect_ciphertexts(key, first, N, seed, threads, output, model);
+}
+#endif /* !SIM_LIBRARY */
@@ -0,0 +1,145 @@
+/*
+ * Online persistent fault analysis, see pfa.h
+ */
+
+#include "pfa.h"
+#include <string.h>
+
+static const uint8_t rcon[10] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36
+};
+
+void pfa_init(struct pfa_state *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->f = -1;
+}
+
+void pfa_update(struct pfa_state *st, const unsigned char *cpts, size_t count)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < count; i++, cpts += 16) {
+        for (j = 0; j < 16; j++) {
+            st->counter[j][cpts[j]]++;
+        }
+    }
+    st->n += count;
+}
+
+int pfa_check(struct pfa_state *st, int patience)
+{
+    uint8_t cmin[16], cmax[16];
+    int fcount[256] = {0};
+    int f = -1, j, v;
+
+    for (j = 0; j < 16; j++) {
+        const uint32_t *c = st->counter[j];
+        int zeros = 0;
+
+        cmin[j] = 0;
+        cmax[j] = 0;
+        for (v = 0; v < 256; v++) {
+            if (c[v] == 0) {
+                zeros++;
+                cmin[j] = (uint8_t) v;
+            }
+            if (c[v] > c[cmax[j]]) {
+                cmax[j] = (uint8_t) v;
+            }
+        }
+        if (zeros != 1) {
+            break;
+        }
+        if (++fcount[cmin[j] ^ cmax[j]] > 8) {
+            f = cmin[j] ^ cmax[j];
+        }
+    }
+
+    if (j < 16 || f < 0) {
+        st->stable = 0;
+        st->f = -1;
+        return 0;
+    }
+
+    if (st->f == f && memcmp(st->cmin, cmin, 16) == 0) {
+        st->stable++;
+    } else {
+        st->stable = 1;
+    }
+    memcpy(st->cmin, cmin, 16);
+    memcpy(st->cmax, cmax, 16);
+    st->f = f;
+
+    return st->stable >= patience;
+}
+
+void pfa_inverse_key_schedule(const unsigned char sbox[256], const unsigned char last_rk[16],
+                              unsigned char master_key[16])
+{
+    unsigned char w[16];
+    int r, j;
+
+    memcpy(w, last_rk, 16);
+    for (r = 9; r >= 0; r--) {
+        // words 1..3 of round key r
+        for (j = 15; j >= 4; j--) {
+            w[j] ^= w[j - 4];
+        }
+        // word 0: undo SubWord(RotWord(word 3)) and Rcon
+        w[0] ^= sbox[w[13]] ^ rcon[r];
+        w[1] ^= sbox[w[14]];
+        w[2] ^= sbox[w[15]];
+        w[3] ^= sbox[w[12]];
+    }
+    memcpy(master_key, w, 16);
+}
+
+void pfa_key_schedule_entries(const unsigned char sbox[256], const unsigned char key[16],
+                              uint8_t used[32])
+{
+    unsigned char w[16], t[4];
+    int r, j;
+
+    memset(used, 0, 32);
+    memcpy(w, key, 16);
+    for (r = 0; r < 10; r++) {
+        // SubWord(RotWord(word 3)) reads the S-box at the 4 bytes of word 3
+        for (j = 0; j < 4; j++) {
+            used[w[12 + j] >> 3] |= (uint8_t) (1 << (w[12 + j] & 7));
+        }
+        t[0] = sbox[w[13]] ^ rcon[r];
+        t[1] = sbox[w[14]];
+        t[2] = sbox[w[15]];
+        t[3] = sbox[w[12]];
+        for (j = 0; j < 16; j++) {
+            w[j] ^= (j < 4) ? t[j] : w[j - 4];
+        }
+    }
+}
+
+int pfa_recover(const struct pfa_state *st, const unsigned char sbox[256],
+                const unsigned char key[16])
+{
+    unsigned char fs[256], last_rk[16], master_key[16];
+    int i, j;
+
+    if (st->f < 0) {
+        return -1;
+    }
+
+    memcpy(fs, sbox, 256);
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < 16; j++) {
+            last_rk[j] = sbox[i] ^ st->cmin[j];
+        }
+        fs[i] ^= (unsigned char) st->f;
+        pfa_inverse_key_schedule(fs, last_rk, master_key);
+        fs[i] = sbox[i];
+        if (memcmp(master_key, key, 16) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,76 @@
+/**
+ * \file pfa.h
+ *
+ * \brief Online persistent fault analysis of the simulated ciphertexts
+ *
+ * The per-byte histograms of keyrecovery.py are maintained while encrypting,
+ * and the campaign stops as soon as the c_min/c_max decision and the fault
+ * value f are stable.
+ */
+
+#ifndef PFA_H
+#define PFA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct pfa_state {
+    uint32_t counter[16][256];  // occurrences of each value of each ciphertext byte
+    uint64_t n;                 // ciphertexts counted so far
+    uint8_t cmin[16];           // missing value of each byte, valid when all bytes have one
+    uint8_t cmax[16];
+    int f;                      // majority of cmin ^ cmax, -1 if no majority
+    int stable;                 // consecutive checks with the same decision
+};
+
+struct pfa_result {
+    uint64_t n;                 // ciphertexts needed to reach the decision
+    int decided;                // 1 if the decision became stable within the budget
+    int f;                      // decided fault value
+    int location;               // S-box index whose candidate key matched, -1 if none
+    int recovered;              // 1 if the master key was recovered
+};
+
+void pfa_init(struct pfa_state *st);
+
+/*
+ * Count `count` ciphertexts of 16 bytes
+ */
+void pfa_update(struct pfa_state *st, const unsigned char *cpts, size_t count);
+
+/*
+ * Recompute the decision. The decision is made when every byte has a single
+ * value that never occurred (c_min) and a majority of the bytes agree on
+ * f = c_min ^ c_max. Returns 1 once the same decision has been made on
+ * `patience` consecutive checks.
+ */
+int pfa_check(struct pfa_state *st, int patience);
+
+/*
+ * Invert the AES-128 key schedule computed with the S-box `sbox`
+ */
+void pfa_inverse_key_schedule(const unsigned char sbox[256], const unsigned char last_rk[16],
+                              unsigned char master_key[16]);
+
+/*
+ * Set in the 256-bit map `used` the S-box inputs read by the AES-128 key
+ * schedule of `key` computed with the S-box `sbox`. Skipping the table
+ * computation at one of these indices is what faults the round keys.
+ */
+void pfa_key_schedule_entries(const unsigned char sbox[256], const unsigned char key[16],
+                              uint8_t used[32]);
+
+static inline int pfa_entry_used(const uint8_t used[32], int index)
+{
+    return (used[index >> 3] >> (index & 7)) & 1;
+}
+
+/*
+ * Try the 256 faulty S-box entries with the decided c_min and f, as
+ * keyrecovery.py does, and compare each candidate master key to `key`.
+ * Returns the matching S-box index, or -1.
+ */
+int pfa_recover(const struct pfa_state *st, const unsigned char sbox[256],
+                const unsigned char key[16]);
+
+#endif /* PFA_H */
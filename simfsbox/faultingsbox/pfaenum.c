@@ -0,0 +1,368 @@
+/*
+ * Ranked key enumeration for the PFA, see pfaenum.h
+ */
+
+#include "pfaenum.h"
+#include "sim.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define XTIME(x) ((uint8_t) (((x) << 1) ^ (((x) & 0x80) ? 0x1B : 0x00)))
+#define ROTL8(x) ((((x) << 8) & 0xFFFFFFFF) | ((x) >> 24))
+#define BYTE(x, n) ((uint8_t) ((x) >> (8 * (n))))
+#define GET_U32_LE(b, i) ((uint32_t) (b)[i] | ((uint32_t) (b)[(i) + 1] << 8) | \
+                          ((uint32_t) (b)[(i) + 2] << 16) | ((uint32_t) (b)[(i) + 3] << 24))
+
+static const uint8_t rcon[10] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36
+};
+
+/*
+ * Candidates of each byte for one fault value, by decreasing score
+ */
+struct enum_lists {
+    int len[16];
+    uint8_t m[16][256];
+    int score[16][256];
+    int smax[17], smin[17];     // best and worst total score of bytes j..15
+};
+
+/*
+ * Tables of the faulty S-box, patched in place for each entry i
+ */
+struct enum_tables {
+    uint8_t sb[256];
+    uint32_t T0[256], T1[256], T2[256], T3[256];
+};
+
+struct enum_shared {
+    const struct enum_lists *lists;     // indexed by f, 1..255
+    const uint8_t *pts, *cpts;
+    int npairs;
+    int tmin;
+    uint64_t budget;
+    volatile uint64_t seq;      // candidates enumerated so far, by every thread
+    volatile int stop;
+    pthread_mutex_t lock;
+    int total, f, r;            // next subtree, see next_subtree()
+    struct pfa_enum_result *res;
+};
+
+struct enum_job {
+    struct enum_shared *sh;
+    uint64_t tested;
+    uint8_t cur[16];
+    struct enum_tables tab;
+};
+
+/*
+ * The fault-free S-box, from the tables of the simulator (main.c built into
+ * this library with -DSIM_LIBRARY)
+ */
+static uint8_t clean_sbox[256];
+static pthread_once_t clean_sbox_once = PTHREAD_ONCE_INIT;
+
+static void gen_clean_sbox(void)
+{
+    sim_set_fault(-1, 4);      // no fault: the skipped step is ignored
+    sim_get_sbox(clean_sbox);
+}
+
+static void set_entry(struct enum_tables *tab, int i, uint8_t x)
+{
+    uint8_t y = XTIME(x), z = y ^ x;
+
+    tab->sb[i] = x;
+    tab->T0[i] = ((uint32_t) y) ^ ((uint32_t) x << 8) ^
+                 ((uint32_t) x << 16) ^ ((uint32_t) z << 24);
+    tab->T1[i] = ROTL8(tab->T0[i]);
+    tab->T2[i] = ROTL8(tab->T1[i]);
+    tab->T3[i] = ROTL8(tab->T2[i]);
+}
+
+/*
+ * Whether the round keys, inverted from `last_rk` through the AES-128 key
+ * schedule of mbedtls under the S-box of `tab`, encrypt every plaintext to
+ * its ciphertext; the master key is left in `master_key`
+ */
+static int check_key(const struct enum_tables *tab, const uint8_t last_rk[16],
+                     const uint8_t *pts, const uint8_t *cpts, int npairs, uint8_t master_key[16])
+{
+    uint32_t RK[44], X[4], Y[4];
+    int r, i, p;
+
+    for (i = 0; i < 4; i++) {
+        RK[40 + i] = GET_U32_LE(last_rk, 4 * i);
+    }
+    for (r = 9; r >= 0; r--) {
+        uint32_t *W = RK + 4 * r;
+
+        W[3] = W[7] ^ W[6];
+        W[2] = W[6] ^ W[5];
+        W[1] = W[5] ^ W[4];
+        W[0] = W[4] ^ rcon[r] ^
+               ((uint32_t) tab->sb[BYTE(W[3], 1)]) ^
+               ((uint32_t) tab->sb[BYTE(W[3], 2)] <<  8) ^
+               ((uint32_t) tab->sb[BYTE(W[3], 3)] << 16) ^
+               ((uint32_t) tab->sb[BYTE(W[3], 0)] << 24);
+    }
+
+    for (p = 0; p < npairs; p++, pts += 16, cpts += 16) {
+        const uint32_t *K = RK;
+
+        for (i = 0; i < 4; i++) {
+            X[i] = GET_U32_LE(pts, 4 * i) ^ *K++;
+        }
+        for (r = 1; r < 10; r++) {
+            for (i = 0; i < 4; i++) {
+                Y[i] = *K++ ^ tab->T0[BYTE(X[i], 0)] ^
+                       tab->T1[BYTE(X[(i + 1) & 3], 1)] ^
+                       tab->T2[BYTE(X[(i + 2) & 3], 2)] ^
+                       tab->T3[BYTE(X[(i + 3) & 3], 3)];
+            }
+            memcpy(X, Y, sizeof(X));
+        }
+        // Most keys fail on the first word of the first pair
+        for (i = 0; i < 4; i++) {
+            Y[i] = *K++ ^
+                   ((uint32_t) tab->sb[BYTE(X[i], 0)]) ^
+                   ((uint32_t) tab->sb[BYTE(X[(i + 1) & 3], 1)] <<  8) ^
+                   ((uint32_t) tab->sb[BYTE(X[(i + 2) & 3], 2)] << 16) ^
+                   ((uint32_t) tab->sb[BYTE(X[(i + 3) & 3], 3)] << 24);
+            if (Y[i] != GET_U32_LE(cpts, 4 * i)) {
+                return 0;
+            }
+        }
+    }
+
+    for (i = 0; i < 16; i++) {
+        master_key[i] = BYTE(RK[i >> 2], i & 3);
+    }
+    return 1;
+}
+
+/*
+ * Try the candidate last round key job->cur - S[i] with every faulty entry i
+ */
+static void try_candidate(struct enum_job *job, int f, int score, uint64_t seq)
+{
+    struct enum_shared *sh = job->sh;
+    uint8_t last_rk[16], master_key[16];
+    int i, j;
+
+    for (i = 0; i < 256 && !sh->stop; i++) {
+        uint8_t s = job->tab.sb[i];
+
+        for (j = 0; j < 16; j++) {
+            last_rk[j] = job->cur[j] ^ s;
+        }
+        set_entry(&job->tab, i, s ^ (uint8_t) f);
+        job->tested++;
+        if (check_key(&job->tab, last_rk, sh->pts, sh->cpts, sh->npairs, master_key) &&
+            __sync_bool_compare_and_swap(&sh->stop, 0, 1)) {
+            struct pfa_enum_result *res = sh->res;
+
+            res->found = 1;
+            res->location = i;
+            res->f = f;
+            res->score = score;
+            res->rank = seq;
+            memcpy(res->last_rk, last_rk, 16);
+            memcpy(res->master_key, master_key, 16);
+        }
+        set_entry(&job->tab, i, s);
+    }
+}
+
+/*
+ * Candidates of bytes j..15 whose scores add up to `rest`
+ */
+static void enumerate(struct enum_job *job, const struct enum_lists *l, int f, int j, int rest,
+                      int score)
+{
+    struct enum_shared *sh = job->sh;
+    int r;
+
+    if (j == 16) {
+        uint64_t seq = __sync_fetch_and_add(&sh->seq, 1);
+
+        if ((seq + 1) * 256 > sh->budget) {
+            sh->stop = 1;
+            return;
+        }
+        try_candidate(job, f, score, seq);
+        return;
+    }
+
+    for (r = 0; r < l->len[j] && !sh->stop; r++) {
+        int left = rest - l->score[j][r];
+
+        if (left > l->smax[j + 1]) {
+            break;      // the scores that follow are lower still
+        }
+        if (left < l->smin[j + 1]) {
+            continue;
+        }
+        job->cur[j] = l->m[j][r];
+        enumerate(job, l, f, j + 1, left, score);
+    }
+}
+
+/*
+ * Next subtree of the enumeration, for the calling thread: the candidates of
+ * fault value `f` and total score `total` whose byte 0 is the `r`-th of its
+ * list. Subtrees are handed out by decreasing total, then increasing f and
+ * r, so each candidate is visited by one thread only. Returns 0 at the end.
+ */
+static int next_subtree(struct enum_shared *sh, int *total, int *f, int *r)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&sh->lock);
+    while (!found && !sh->stop && sh->total >= sh->tmin) {
+        const struct enum_lists *l = &sh->lists[sh->f];
+
+        if (sh->r < l->len[0] && sh->total <= l->smax[0] && sh->total >= l->smin[0]) {
+            int left = sh->total - l->score[0][sh->r];
+
+            if (left > l->smax[1]) {
+                sh->r = l->len[0];      // the scores that follow are lower still
+                continue;
+            }
+            if (left >= l->smin[1]) {
+                *total = sh->total;
+                *f = sh->f;
+                *r = sh->r;
+                found = 1;
+            }
+            sh->r++;
+            continue;
+        }
+        sh->r = 0;
+        if (++sh->f == 256) {
+            sh->f = 1;
+            sh->total--;
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
+static void *enum_worker(void *arg)
+{
+    struct enum_job *job = arg;
+    struct enum_shared *sh = job->sh;
+    int total, f, r;
+
+    while (next_subtree(sh, &total, &f, &r)) {
+        const struct enum_lists *l = &sh->lists[f];
+
+        job->cur[0] = l->m[0][r];
+        enumerate(job, l, f, 1, total - l->score[0][r], total);
+    }
+    return NULL;
+}
+
+static void build_lists(const uint64_t counts[16][256], int f, struct enum_lists *l)
+{
+    int j, v, a, b;
+
+    l->smax[16] = l->smin[16] = 0;
+    for (j = 15; j >= 0; j--) {
+        l->len[j] = 0;
+        for (v = 0; v < 256; v++) {
+            if (counts[j][v] == 0) {
+                uint64_t c = counts[j][v ^ f];
+
+                l->m[j][l->len[j]] = (uint8_t) v;
+                l->score[j][l->len[j]] = c > (1u << 20) ? (1 << 20) : (int) c;
+                l->len[j]++;
+            }
+        }
+        // Insertion sort by decreasing score, stable in the value
+        for (a = 1; a < l->len[j]; a++) {
+            uint8_t m = l->m[j][a];
+            int s = l->score[j][a];
+
+            for (b = a; b > 0 && l->score[j][b - 1] < s; b--) {
+                l->m[j][b] = l->m[j][b - 1];
+                l->score[j][b] = l->score[j][b - 1];
+            }
+            l->m[j][b] = m;
+            l->score[j][b] = s;
+        }
+        if (l->len[j] == 0) {
+            l->len[0] = 0;      // no candidate for this byte
+            return;
+        }
+        l->smax[j] = l->smax[j + 1] + l->score[j][0];
+        l->smin[j] = l->smin[j + 1] + l->score[j][l->len[j] - 1];
+    }
+}
+
+int pfa_enum_recover(const uint64_t counts[16][256], const uint8_t *pts, const uint8_t *cpts,
+                     int npairs, uint64_t budget, int threads, struct pfa_enum_result *res)
+{
+    struct enum_shared sh;
+    struct enum_job *jobs;
+    pthread_t tids[PFA_ENUM_MAX_THREADS];
+    struct enum_lists *lists;
+    int f, t;
+
+    memset(res, 0, sizeof(*res));
+    res->location = -1;
+    res->f = -1;
+    if (npairs < 1 || npairs > PFA_ENUM_MAX_PAIRS) {
+        return -1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > PFA_ENUM_MAX_THREADS) threads = PFA_ENUM_MAX_THREADS;
+
+    lists = malloc(256 * sizeof(*lists));
+    jobs = malloc((size_t) threads * sizeof(*jobs));
+    if (lists == NULL || jobs == NULL) {
+        free(lists);
+        free(jobs);
+        return -1;
+    }
+
+    memset(&sh, 0, sizeof(sh));
+    sh.lists = lists;
+    sh.pts = pts;
+    sh.cpts = cpts;
+    sh.npairs = npairs;
+    sh.budget = budget;
+    sh.res = res;
+    sh.total = -1;
+    sh.tmin = 1 << 30;
+    sh.f = 1;
+    for (f = 1; f < 256; f++) {
+        build_lists(counts, f, &lists[f]);
+        if (lists[f].len[0] > 0) {
+            if (lists[f].smax[0] > sh.total) sh.total = lists[f].smax[0];
+            if (lists[f].smin[0] < sh.tmin) sh.tmin = lists[f].smin[0];
+        }
+    }
+    pthread_mutex_init(&sh.lock, NULL);
+
+    pthread_once(&clean_sbox_once, gen_clean_sbox);
+    for (t = 0; t < threads; t++) {
+        jobs[t].sh = &sh;
+        jobs[t].tested = 0;
+        for (f = 0; f < 256; f++) {
+            set_entry(&jobs[t].tab, f, clean_sbox[f]);
+        }
+        if (threads > 1) pthread_create(&tids[t], NULL, enum_worker, &jobs[t]);
+    }
+    if (threads == 1) enum_worker(&jobs[0]);
+    for (t = 0; t < threads; t++) {
+        if (threads > 1) pthread_join(tids[t], NULL);
+        res->tested += jobs[t].tested;
+    }
+    pthread_mutex_destroy(&sh.lock);
+
+    free(lists);
+    free(jobs);
+    return res->found ? 0 : -1;
+}
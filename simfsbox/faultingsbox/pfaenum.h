@@ -0,0 +1,47 @@
+/**
+ * \file pfaenum.h
+ *
+ * \brief Ranked key enumeration for the PFA with few ciphertexts
+ *
+ * With too few ciphertexts, several values of a ciphertext byte have not been
+ * seen yet and the missing one (c_min) is ambiguous. Every unseen value m of
+ * byte j is a candidate, scored by its log-likelihood: the value m ^ f that
+ * the faulty entry doubles has probability 2/256 instead of 1/256, so the
+ * score of m is the count of m ^ f (in units of ln 2). Candidate last round
+ * keys (one m per byte, with a fault value f) are enumerated by decreasing
+ * total score; each is tried with every faulty S-box entry i, inverted through
+ * the key schedule under the faulty S-box and checked against known
+ * plaintext/ciphertext pairs of the faulty device, on several threads, until
+ * a key matches or the work budget is spent. Built as libpfaenum.so for
+ * keyrecovery.py.
+ */
+
+#ifndef PFAENUM_H
+#define PFAENUM_H
+
+#include <stdint.h>
+
+#define PFA_ENUM_MAX_PAIRS   8
+#define PFA_ENUM_MAX_THREADS 64
+
+struct pfa_enum_result {
+    uint64_t tested;            // keys checked, one per (last round key, i, f)
+    uint64_t rank;              // candidate last round keys started before the match, by all threads
+    int found;                  // 1 if a key matched every pair
+    int location;               // faulty S-box entry i
+    int f;                      // fault value
+    int score;                  // score of the matching last round key
+    uint8_t last_rk[16];
+    uint8_t master_key[16];
+};
+
+/*
+ * Enumerate from the byte counts `counts` of the faulty ciphertexts and check
+ * the keys against the `npairs` plaintexts `pts` and ciphertexts `cpts`, at
+ * most `budget` keys on `threads` threads. Returns 0 if a key was found,
+ * -1 otherwise (budget spent, candidates exhausted or invalid arguments).
+ */
+int pfa_enum_recover(const uint64_t counts[16][256], const uint8_t *pts, const uint8_t *cpts,
+                     int npairs, uint64_t budget, int threads, struct pfa_enum_result *res);
+
+#endif /* PFAENUM_H */
@@ -0,0 +1,41 @@
+/**
+ * \file prng.h
+ *
+ * \brief Counter-based generator of simulation plaintexts
+ *
+ * Block i of a campaign is a pure function of (seed, i), so the ciphertexts
+ * do not depend on how the blocks are split across threads.
+ */
+
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+
+/*
+ * SplitMix64 finaliser applied to the counter `ctr` of stream `seed`
+ */
+static inline uint64_t prng_word(uint64_t seed, uint64_t ctr)
+{
+    uint64_t z = seed + (ctr + 1) * 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Plaintext number `index` of stream `seed`
+ */
+static inline void prng_block(uint64_t seed, uint64_t index, unsigned char out[16])
+{
+    uint64_t lo = prng_word(seed, 2 * index);
+    uint64_t hi = prng_word(seed, 2 * index + 1);
+
+    for (int j = 0; j < 8; j++) {
+        out[j]     = (unsigned char) (lo >> (8 * j));
+        out[j + 8] = (unsigned char) (hi >> (8 * j));
+    }
+}
+
+#endif /* PRNG_H */
@@ -0,0 +1,54 @@
+/**
+ * \file sim.h
+ *
+ * \brief Shared-library interface of the simulator
+ *
+ * main.c built with -DSIM_LIBRARY, without main(): libsim.so for simlib.py,
+ * and the S-box of libpfaenum.so. The tables are global, so a process
+ * simulates one fault at a time. Every buffer belongs to the caller.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "aes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+size_t sim_context_size(void);
+
+/*
+ * Regenerate the tables with step `op` (1..4, enum skip_op of main.c) of the
+ * S-box loop skipped at index `location` (-1: no fault). Contexts set up
+ * before keep the round keys of the old S-box. Returns -1 on invalid input.
+ */
+int sim_set_fault(int location, int op);
+
+void sim_get_sbox(unsigned char sbox[256]);
+
+/*
+ * Key schedule of `key` under the current (faulted) S-box into `ctx`
+ */
+int sim_setkey(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits);
+
+/*
+ * Round keys of `ctx` as 4 * (nr + 1) little-endian words; returns nr
+ */
+int sim_round_keys(const mbedtls_aes_context *ctx, uint32_t *rk);
+
+/*
+ * Plaintexts first..first+n-1 of the stream of `seed`, as main -s seed
+ */
+void sim_plaintexts(uint64_t seed, uint64_t first, unsigned char *pts, size_t n);
+
+void sim_encrypt(const mbedtls_aes_context *ctx, const unsigned char *pts, unsigned char *cpts,
+                 size_t n);
+
+/*
+ * Add the byte counts of the ciphertexts of plaintexts first..first+n-1 of
+ * the stream of `seed` to `counts`, without storing the ciphertexts
+ */
+void sim_count(const mbedtls_aes_context *ctx, uint64_t seed, uint64_t first, uint64_t n,
+               uint64_t counts[16][256]);
+
+#endif /* SIM_H */
@@ -0,0 +1,39 @@
+import numpy as np
+
+# Convergence curves of the byte frequencies, plotted by simfsbox/visualize.py
+# and expfsbox/visualize.py.
+
+# Plotted points when the step is derived from the number of ciphertexts
+DEFAULT_POINTS = 1000
+
+
+def sample_points(N, step=0, log_points=0):
+    """
+    Numbers of ciphertexts at which the frequencies are plotted: `log_points`
+    log-spaced points, else one every `step` ciphertexts, else about
+    DEFAULT_POINTS evenly spaced points whatever N is.
+    """
+    if log_points > 0:
+        points = np.geomspace(1, N, num=log_points)
+    else:
+        step = step if step > 0 else max(1, N // DEFAULT_POINTS)
+        points = np.arange(step, N + 1, step)
+    points = np.unique(np.append(np.round(points).astype(np.int64), N))
+    return points[points > 0]
+
+
+def frequency_curves(column, points):
+    """
+    probs[k, v]: frequency of value v among the first points[k] entries of `column`.
+
+    The counts are carried over from one point to the next, so each ciphertext
+    is counted once and only the (len(points), 256) result is allocated.
+    """
+    probs = np.empty((len(points), 256), dtype=np.float32)
+    counts = np.zeros(256, dtype=np.int64)
+    start = 0
+    for k, n in enumerate(points):
+        counts += np.bincount(column[start:n], minlength=256)
+        probs[k] = counts / n
+        start = n
+    return probs
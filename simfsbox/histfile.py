@@ -0,0 +1,108 @@
+import numpy as np
+from cptsfile import FAULT_MODELS
+
+# Histogram shard written by faultingsbox/main when the output ends with .hist:
+# a 64-byte little-endian header, the byte counts as uint64[16][256], the
+# ranges of block indices that were counted and a few ciphertexts with their
+# block index (see faultingsbox/histfile.h).
+MAGIC = b"PFAHIST\x00"
+HEADER = np.dtype([
+    ("magic",          "S8"),
+    ("version",        "<u4"),
+    ("fault_model",    "<u4"),
+    ("fault_location", "<i4"),
+    ("fault_op",       "<u4"),
+    ("key_id",         "<u4"),
+    ("nranges",        "<u4"),
+    ("nsamples",       "<u4"),
+    ("reserved",       "<u4"),
+    ("seed",           "<u8"),
+    ("count",          "<u8"),
+    ("pad",            "V8"),
+])
+RANGE = np.dtype([("first", "<u8"), ("count", "<u8")])
+SAMPLE = np.dtype([("index", "<u8"), ("cpt", "u1", 16)])
+SAMPLES = 4
+# Header fields that identify a campaign: only shards that agree on them are merged
+CAMPAIGN = ("fault_model", "fault_location", "fault_op", "key_id", "seed")
+
+
+def is_shard(path):
+    with open(path, "rb") as f: return f.read(len(MAGIC)) == MAGIC
+
+
+def read_shard(path):
+    """Shard of `path` as a dict: the header fields, `counts` (16,256),
+    `ranges` [(first, count)] and `samples` [(index, ciphertext bytes)]"""
+    with open(path, "rb") as f: raw = f.read()
+    assert raw.startswith(MAGIC), f"{path} is not a histogram shard"
+    hdr = np.frombuffer(raw, dtype=HEADER, count=1)[0]
+    shard = {name: hdr[name].item() for name in HEADER.names if name not in ("magic", "pad")}
+    offset = HEADER.itemsize
+    shard["counts"] = np.frombuffer(raw, dtype="<u8", count=16*256, offset=offset).reshape(16, 256).astype(np.int64)
+    offset += 16*256*8
+    ranges = np.frombuffer(raw, dtype=RANGE, count=shard["nranges"], offset=offset)
+    offset += ranges.nbytes
+    samples = np.frombuffer(raw, dtype=SAMPLE, count=shard["nsamples"], offset=offset)
+    shard["ranges"] = [(int(r["first"]), int(r["count"])) for r in ranges]
+    shard["samples"] = [(int(s["index"]), bytes(s["cpt"])) for s in samples]
+    return shard
+
+
+def write_shard(path, shard):
+    hdr = np.zeros(1, dtype=HEADER)
+    hdr["magic"] = MAGIC
+    hdr["version"] = 1
+    for name in CAMPAIGN + ("count",):
+        hdr[name] = shard[name]
+    hdr["nranges"] = len(shard["ranges"])
+    hdr["nsamples"] = len(shard["samples"])
+    ranges = np.array(shard["ranges"], dtype=np.uint64).reshape(-1, 2)
+    samples = np.zeros(len(shard["samples"]), dtype=SAMPLE)
+    for n, (index, cpt) in enumerate(shard["samples"]):
+        samples[n] = (index, np.frombuffer(cpt, dtype=np.uint8))
+    with open(path, "wb") as f:
+        f.write(hdr.tobytes())
+        f.write(np.asarray(shard["counts"], dtype="<u8").tobytes())
+        f.write(ranges.astype("<u8").tobytes())
+        f.write(samples.tobytes())
+
+
+def merge_shards(shards):
+    """
+    Sum of shards of one campaign.
+
+    The ranges are merged as sets of block indices and must not overlap, since
+    a block counted twice would bias the histograms; adjacent ranges are
+    joined. The samples with the smallest indices are kept. The result does not
+    depend on the order or grouping of the merges.
+    """
+    shards = list(shards)
+    assert shards, "Nothing to merge"
+    merged = {name: shards[0][name] for name in CAMPAIGN}
+    for shard in shards[1:]:
+        diff = [name for name in CAMPAIGN if shard[name] != merged[name]]
+        assert not diff, f"Shards of different campaigns ({', '.join(diff)})"
+
+    merged["counts"] = sum(shard["counts"] for shard in shards)
+    ranges = []
+    for first, count in sorted(r for shard in shards for r in shard["ranges"] if r[1] > 0):
+        if ranges and first < ranges[-1][0] + ranges[-1][1]:
+            raise ValueError(f"Block {first} is counted by several shards")
+        if ranges and first == ranges[-1][0] + ranges[-1][1]:
+            ranges[-1] = (ranges[-1][0], ranges[-1][1] + count)
+        else:
+            ranges.append((first, count))
+    merged["ranges"] = ranges
+    merged["count"] = sum(count for _, count in ranges)
+    merged["samples"] = sorted(dict(s for shard in shards for s in shard["samples"]).items())[:SAMPLES]
+    return merged
+
+
+def describe(shard):
+    """One-line summary of the shard metadata"""
+    model = shard["fault_model"]
+    model = FAULT_MODELS[model] if model < len(FAULT_MODELS) else str(model)
+    ranges = ", ".join(f"{first}..{first + count - 1}" for first, count in shard["ranges"])
+    return (f"fault model = {model}, fault location = {shard['fault_location']}, "
+            f"key id = {shard['key_id']}, seed = {shard['seed']}, blocks {ranges}")
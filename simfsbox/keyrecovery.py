@@ -1,5 +1,11 @@
 import numpy as np
 import argparse
+import os
+import time
+from cptsfile import iter_ciphertexts, describe, read_header
+import histfile
+import pfanative
+from mlscore import MLScorer
 
 
 S = [
@@ -30,65 +36,95 @@ RCON = [
     0xD4, 0xB3, 0x7D, 0xFA, 0xEF, 0xC5, 0x91, 0x39,
 ]
 
-def getfaultedSbox(i, f):
-    FS = S[:]
-    FS[i] ^= f
-    return FS
+# Offset of ciphertext byte j in the flattened 16x256 counter
+OFFSETS = (np.arange(16) * 256).astype(np.uint16)
 
+def count_bytes(cpts):
+    """16x256 occurrence counts of the bytes of an (N,16) uint8 array of ciphertexts"""
+    cpts = np.asarray(cpts, dtype=np.uint8).reshape(-1, 16)
+    return np.bincount((cpts + OFFSETS).ravel(), minlength=16*256).reshape(16, 256)
 
-def inverse_key_schedule(SBOX, key):
-    assert len(key) == 16
-    Nr = 10
 
-    # Round 0
-    round_keys = list(key[:])
-    
-    # Round ri: 1-10
-    for ri in range(Nr-1, -1, -1):
-        new_round_key = []
-
-        new_round_key.append(round_keys[ 0] ^ round_keys[ 4])
-        new_round_key.append(round_keys[ 1] ^ round_keys[ 5])
-        new_round_key.append(round_keys[ 2] ^ round_keys[ 6])
-        new_round_key.append(round_keys[ 3] ^ round_keys[ 7])
-
-        new_round_key.append(round_keys[ 4] ^ round_keys[ 8])
-        new_round_key.append(round_keys[ 5] ^ round_keys[ 9])
-        new_round_key.append(round_keys[ 6] ^ round_keys[10])
-        new_round_key.append(round_keys[ 7] ^ round_keys[11])
-
-        new_round_key.append(round_keys[ 8] ^ round_keys[12])
-        new_round_key.append(round_keys[ 9] ^ round_keys[13])
-        new_round_key.append(round_keys[10] ^ round_keys[14])
-        new_round_key.append(round_keys[11] ^ round_keys[15])
-
-
-        # RotWord
-        c0 = new_round_key[ 9]
-        c1 = new_round_key[10]
-        c2 = new_round_key[11]
-        c3 = new_round_key[ 8]
-
-        # SubWord
-        c0 = SBOX[c0]
-        c1 = SBOX[c1]
-        c2 = SBOX[c2]
-        c3 = SBOX[c3]
-
-        # XOR
-        c0 ^= round_keys[0]
-        c1 ^= round_keys[1]
-        c2 ^= round_keys[2]
-        c3 ^= round_keys[3]
-
-        # Rcon
-        c0 ^= RCON[ri+1]
-
-        # New round key
-        new_round_key = [c0, c1, c2, c3] + new_round_key
-        round_keys = new_round_key + round_keys
-    
-    return round_keys
+def count_chunks(chunks):
+    """count_bytes() accumulated over an iterable of ciphertext chunks"""
+    counter = np.zeros((16,256), dtype=np.int64)
+    for cpts in chunks:
+        counter += count_bytes(cpts)
+    return counter
+
+
+SBOX = np.array(S, dtype=np.uint8)
+XTIME = np.array([((a << 1) ^ 0x1B) & 0xFF if a & 0x80 else a << 1 for a in range(256)], dtype=np.uint8)
+SHIFT_ROWS = np.array([0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11])
+MASK64 = (1 << 64) - 1
+# Posterior of the ML fault value below which every fault value is tried
+ML_CONFIDENCE = 0.99
+
+
+def candidates(cmin, faults):
+    """Faulted S-boxes (M,256) and last round keys (M,16) of every hypothesis
+    (i, f) with f in `faults`: S'[i] = S[i] ^ f and k_j = cmin_j ^ S[i]"""
+    i, f = np.meshgrid(np.arange(256), np.asarray(faults), indexing="ij")
+    i, f = i.ravel(), f.ravel()
+    sboxes = np.tile(SBOX, (len(i), 1))
+    sboxes[np.arange(len(i)), i] ^= f.astype(np.uint8)
+    last_rks = SBOX[i][:, None] ^ np.asarray(cmin, dtype=np.uint8)[None, :]
+    return i, f, sboxes, last_rks
+
+
+def inverse_key_schedule_batch(sboxes, last_rks):
+    """Round keys (M,11,16) of M candidates from their last round keys (M,16),
+    running the key schedule backwards under their S-boxes (M,256)"""
+    rows = np.arange(len(last_rks))[:, None]
+    rks = np.empty((len(last_rks), 11, 16), dtype=np.uint8)
+    rks[:, 10] = last_rks
+    for ri in range(9, -1, -1):
+        nxt = rks[:, ri + 1]
+        rks[:, ri, 4:] = nxt[:, 4:] ^ nxt[:, :12]
+        # SubWord(RotWord(word 3)) ^ Rcon
+        rks[:, ri, :4] = nxt[:, :4] ^ sboxes[rows, rks[:, ri, [13, 14, 15, 12]]]
+        rks[:, ri, 0] ^= RCON[ri + 1]
+    return rks
+
+
+def encrypt_batch(sboxes, rks, pts):
+    """Ciphertexts (M,P,16) of the plaintexts (P,16) under each candidate"""
+    rows = np.arange(len(rks))[:, None, None]
+    s = np.asarray(pts, dtype=np.uint8)[None] ^ rks[:, None, 0]
+    for r in range(1, 11):
+        s = sboxes[rows, s][..., SHIFT_ROWS]
+        if r < 10:
+            a = s.reshape(s.shape[:-1] + (4, 4))
+            x = a[..., 0] ^ a[..., 1] ^ a[..., 2] ^ a[..., 3]
+            s = (a ^ x[..., None] ^ XTIME[a ^ np.roll(a, -1, axis=-1)]).reshape(s.shape)
+        s = s ^ rks[:, None, r]
+    return s
+
+
+def prng_block(seed, index):
+    """Plaintext `index` of stream `seed`, as faultingsbox/prng.h"""
+    out = b''
+    for ctr in (2 * index, 2 * index + 1):
+        z = (seed + (ctr + 1) * 0x9E3779B97F4A7C15) & MASK64
+        z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & MASK64
+        z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK64
+        out += (z ^ (z >> 31)).to_bytes(8, 'little')
+    return out
+
+
+def recover_keys(cmin, faults, pts, cpts):
+    """(i, f, master key) of the hypotheses whose key and faulted S-box
+    re-encrypt every plaintext of `pts` to its ciphertext in `cpts`"""
+    i, f, sboxes, last_rks = candidates(cmin, faults)
+    rks = inverse_key_schedule_batch(sboxes, last_rks)
+    match = np.all(encrypt_batch(sboxes, rks, pts) == np.asarray(cpts, dtype=np.uint8)[None], axis=(1, 2))
+    return [(int(i[m]), int(f[m]), bytes(rks[m, 0])) for m in np.flatnonzero(match)]
+
+
+def parse_budget(text):
+    """Number of keys, as an integer or a power of two like 2^32"""
+    base, _, exp = text.partition('^')
+    return int(base) ** int(exp) if exp else int(text)
 
 
 if __name__ == "__main__":
@@ -98,58 +134,130 @@ if __name__ == "__main__":
     parser.add_argument('--path-to-file', dest='path_to_file',
                         type=str,
                         default='cpts.txt',
-                        help='Path to the ciphertext file')
+                        help='Path to the ciphertext file (hex text or .bin container) or histogram shard (.hist)')
     
     parser.add_argument('--reference-key', dest='refkey',
                         type=str,
                         default='5b12a47f2b5571191ec06d7c02fc6076',
-                        help='Reference master key')
+                        help='Reference master key, only to report a match')
+
+    parser.add_argument('--seed', type=int, default=None,
+                        help='Seed of the plaintexts (faultingsbox/main -s); default: from the .bin header')
+
+    parser.add_argument('--plaintexts', type=str, default=None,
+                        help='File of the plaintexts of the first ciphertexts, in the same format')
+
+    parser.add_argument('--verify', type=int, default=2,
+                        help='Plaintext/ciphertext pairs each candidate key is checked against')
+
+    parser.add_argument('--all-faults', dest='all_faults', action='store_true',
+                        help='Try every fault value instead of the estimated one')
+
+    parser.add_argument('--scorer', choices=['ml', 'vote'], default='ml',
+                        help='Missing values and fault value from the full histograms (ml) or from cmin/cmax (vote)')
+
+    parser.add_argument('--budget', type=parse_budget,
+                        default=2**32,
+                        help='Keys the ranked enumeration may check if the direct recovery fails, e.g. 2^32')
+
+    parser.add_argument('-j', '--threads', type=int, default=os.cpu_count() or 1,
+                        help='Threads of the ranked enumeration')
+
+    parser.add_argument('--chunk-size', dest='chunk_size',
+                        type=int,
+                        default=1 << 20,
+                        help='Ciphertexts parsed and counted at once, to bound memory (0: all at once)')
 
     config = parser.parse_args()
 
-    with open(config.path_to_file, "r") as f: cpts = f.readlines()
-    cpts = [bytes.fromhex(c.strip()) for c in cpts]
-    N = len(cpts)
+    shard = histfile.read_shard(config.path_to_file) if histfile.is_shard(config.path_to_file) else None
+    if shard is not None:
+        counter = shard["counts"]
+    else:
+        counter = count_chunks(iter_ciphertexts(config.path_to_file, config.chunk_size))
+    N = int(counter[0].sum())
     print(f"There are {N} ciphertexts")
+    if shard is not None: print(histfile.describe(shard))
+    elif describe(config.path_to_file): print(describe(config.path_to_file))
 
-    counter = np.zeros((16,256), dtype=np.uint32)
+    if config.scorer == 'vote':
+        cmin = np.zeros(16, dtype=np.uint8)
+        cmax = np.zeros(16, dtype=np.uint8)
+        fcount = np.zeros(256, dtype=np.uint8)
 
-    for i in range(N):
-        n = i+1
         for j in range(16):
-            counter[j][cpts[i][j]] += 1
+            cmin[j] = np.argmin(counter[j])
+            cmax[j] = np.argmax(counter[j])
+            f = cmin[j] ^ cmax[j]
+            fcount[f] += 1
+            print(f"j = {j:2d}: (cmin, cmax) = ({cmin[j]:3d}, {cmax[j]:3d}), f = {f}")
 
-    cmin = np.zeros(16, dtype=np.uint8)
-    cmax = np.zeros(16, dtype=np.uint8)
-    fcount = np.zeros(256, dtype=np.uint8)
+        f = np.argmax(fcount)
+        print(f"The fault value likely is: {f}, which repeats {fcount[f]}")
+        # all fault values when fewer than half of the bytes agree on one
+        faults = [f] if fcount[f] >= 8 else range(1, 256)
+    else:
+        # Maximum likelihood over the 16x256 counts: one fault value for all the bytes
+        f, cmin, posterior = MLScorer(counter).estimate()
+        print(f"Maximum likelihood: f = {f} (posterior {posterior:.4f}), "
+              f"missing values {bytes(cmin).hex()}")
+        # all fault values when the counts do not single one out
+        faults = [f] if posterior >= ML_CONFIDENCE else range(1, 256)
+    if config.all_faults:
+        faults = range(1, 256)
 
-    for j in range(16):
-        cmin[j] = np.argmin(counter[j])
-        cmax[j] = np.argmax(counter[j])
-        f = cmin[j] ^ cmax[j]
-        fcount[f] += 1
-        print(f"j = {j:2d}: (cmin, cmax) = ({cmin[j]:3d}, {cmax[j]:3d}), f = {f}")
+    # Verification pairs: the first ciphertexts of the file and their plaintexts
+    seed = config.seed
+    if seed is None and shard is not None:
+        seed = shard["seed"]
+    header = read_header(config.path_to_file)
+    if seed is None and header is not None:
+        seed = header["seed"]
+    if shard is not None:
+        # A shard keeps a few ciphertexts with their index in the plaintext stream
+        samples = shard["samples"][:config.verify]
+        pts = np.frombuffer(b"".join(prng_block(seed, n) for n, _ in samples), dtype=np.uint8).reshape(-1, 16)
+        cpts = np.frombuffer(b"".join(c for _, c in samples), dtype=np.uint8).reshape(-1, 16)
+        if not samples: pts = None
+    elif config.plaintexts is not None:
+        pts = next(iter_ciphertexts(config.plaintexts, config.verify))
+    elif seed is not None:
+        pts = np.frombuffer(b"".join(prng_block(seed, n) for n in range(config.verify)),
+                            dtype=np.uint8).reshape(-1, 16)
+    else:
+        pts = None
 
-    f = np.argmax(fcount)
-    print(f"The fault value likely is: {f}, which repeats {fcount[f]}")
+    if pts is not None:
+        if shard is None: cpts = np.asarray(next(iter_ciphertexts(config.path_to_file, len(pts))))
+        found = recover_keys(cmin, faults, pts, cpts)
+        print(f"{256 * len(faults)} candidates checked against {len(pts)} plaintext/ciphertext pairs: "
+              f"{len(found)} verified")
+        if not found and config.budget > 0:
+            # Ambiguous c_min: enumerate the unseen values by likelihood
+            print(f"Ranked enumeration: at most {config.budget} keys on {config.threads} threads")
+            start = time.perf_counter()
+            res = pfanative.enumerate_keys(counter, pts, cpts, config.budget, config.threads)
+            elapsed = time.perf_counter() - start
+            if res is None:
+                print("faultingsbox/libpfaenum.so is not built (cd faultingsbox && make libpfaenum.so)")
+            else:
+                print(f"{res.tested} keys checked in {elapsed:.1f} s ({res.tested / max(elapsed, 1e-9) / 1e6:.1f} M/s)")
+                if res.found:
+                    print(f"Candidate of rank {res.rank}, score {res.score}")
+                    found = [(res.location, res.f, bytes(res.master_key))]
+        for i, f, master_key in found:
+            print(f"Sbox element: {i:3d}, fault value {f}")
+            print(f"Recovered: {master_key.hex()}")
+        if bytes.fromhex(config.refkey) in [m for _, _, m in found]:
+            print("   >>> Bravo! <<<   \n")
+        exit(0 if len(found) == 1 else 1)
 
+    # No plaintexts: list the candidates of the most likely fault value
     refkey = list(bytes.fromhex(config.refkey))
+    i, _, sboxes, last_rks = candidates(cmin, [f])
+    master_keys = inverse_key_schedule_batch(sboxes, last_rks)[:, 0]
     for i in range(256):
-        k = []
-        for j in range(16):
-            k.append(S[i] ^ cmin[j])
-        
-        FS = getfaultedSbox(i, f)
-        print(f"Sbox element: {i:3d} ({FS[i]})")
-
-        print("Last rk  : ", end="")
-        for i in range(0, 16):
-            print(f"{k[i]:02x}, ", end="")
-        print()
-
-        master_key = inverse_key_schedule(FS, k)[:16]
-        print("Recovered: ", end="")
-        for i in range(0, 16):
-            print(f"{master_key[i]:02x}, ", end="")
-        print()
-        if master_key == refkey: print("   >>> Bravo! <<<   \n")
+        print(f"Sbox element: {i:3d} ({sboxes[i, i]})")
+        print("Last rk  : " + "".join(f"{v:02x}, " for v in last_rks[i]))
+        print("Recovered: " + "".join(f"{v:02x}, " for v in master_keys[i]))
+        if list(master_keys[i]) == refkey: print("   >>> Bravo! <<<   \n")
@@ -0,0 +1,21 @@
+import argparse
+from histfile import read_shard, write_shard, merge_shards, describe
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Sum the histogram shards of a campaign")
+
+    parser.add_argument('shards', nargs='+',
+                        help='Shards (.hist) written by faultingsbox/main or by this script')
+
+    parser.add_argument('-o', '--output', type=str,
+                        default='cpts.hist',
+                        help='Merged shard')
+
+    config = parser.parse_args()
+
+    merged = merge_shards(read_shard(path) for path in config.shards)
+    write_shard(config.output, merged)
+    print(f"{len(config.shards)} shards, {merged['count']} ciphertexts into {config.output}")
+    print(describe(merged))
@@ -0,0 +1,143 @@
+import argparse
+import time
+import numpy as np
+
+# Maximum-likelihood estimate of the PFA unknowns from the 16x256 histograms.
+#
+# With S'[i] = S[i] ^ f, ciphertext byte j takes the value m_j = S[i] ^ k_j
+# with probability 0, m_j ^ f with probability 2/256 and every other value
+# with probability 1/256. Up to a constant, the log-likelihood of byte j is
+# -inf if m_j was seen and n_j[m_j ^ f] ln 2 otherwise. The histograms only
+# depend on m_j and f: S[i] and k_j are separated by the key schedule, i.e.
+# by checking the 256 keys k_j = m_j ^ S[i] against a known pair.
+
+XOR = np.arange(256)[:, None] ^ np.arange(256)[None, :]     # XOR[f, m] = m ^ f
+NEG = np.iinfo(np.int64).min // 4
+ROWS = np.arange(16)
+BASE = 65536 * ROWS[:, None] + 256 * np.arange(1, 256)[None, :]     # D[j, f, 0] for f = 1..255
+
+
+class MLScorer:
+    """
+    Scores D[j, f, m] = n_j[m ^ f] if n_j[m] == 0 else -inf, and their maximum
+    best[j, f] over m, kept up to date one ciphertext at a time: a ciphertext
+    adds 1 to D[j, f, c_j ^ f] for every f, and removes the candidate c_j of
+    byte j when it is seen for the first time.
+    """
+
+    def __init__(self, counter=None):
+        self.counter = np.zeros((16, 256), dtype=np.int64)
+        if counter is not None:
+            self.counter += np.asarray(counter, dtype=np.int64)
+        self.D = np.ascontiguousarray(np.where(self.counter[:, None, :] == 0, self.counter[:, XOR], NEG))
+        self.D[:, 0] = NEG      # f = 0 is no fault
+        self.best = self.D.max(axis=2)
+        self.n = int(self.counter[0].sum())
+
+    def update(self, cpt):
+        """Count one 16-byte ciphertext"""
+        c = np.frombuffer(bytes(cpt), dtype=np.uint8).astype(np.intp)
+        flat = BASE + XOR[1:, c].T                   # D[j, f, c_j ^ f] for f = 1..255
+        D, best = self.D.reshape(-1), self.best[:, 1:]
+        D[flat] += 1
+        np.maximum(best, D[flat], out=best)
+        for j in np.flatnonzero(self.counter[ROWS, c] == 0):
+            # c_j is no longer a candidate of byte j: drop it from the maxima it made
+            old = self.D[j, :, c[j]].copy()
+            self.D[j, :, c[j]] = NEG
+            stale = np.flatnonzero(self.best[j] == old)
+            self.best[j, stale] = self.D[j, stale].max(axis=1)
+        self.counter[ROWS, c] += 1
+        self.n += 1
+
+    def loglik(self):
+        """Log-likelihood (in units of ln 2) of each fault value, -inf-like if a byte has no candidate"""
+        return np.where((self.best <= NEG // 2).any(axis=0), NEG, self.best.sum(axis=0))
+
+    def estimate(self):
+        """(f, m, posterior of f): the most likely fault value and missing value of each byte"""
+        ll = self.loglik()
+        f = int(np.argmax(ll))
+        valid = ll > NEG // 2
+        post = np.zeros(256)
+        if valid.any():
+            w = np.exp2((ll[valid] - ll[valid].max()).astype(float))
+            post[valid] = w / w.sum()
+        return f, self.D[:, f].argmax(axis=1).astype(np.uint8), float(post[f])
+
+
+def vote_estimate(counter):
+    """(fault values, cmin) of keyrecovery.py: argmin and argmax per byte, the
+    majority of cmin ^ cmax, or every fault value if fewer than 8 bytes agree"""
+    cmin = np.argmin(counter, axis=1).astype(np.uint8)
+    cmax = np.argmax(counter, axis=1).astype(np.uint8)
+    fcount = np.bincount(cmin ^ cmax, minlength=256)
+    f = int(np.argmax(fcount))
+    return ([f] if fcount[f] >= 8 else range(1, 256)), cmin
+
+
+if __name__ == "__main__":
+    import simlib
+    from keyrecovery import SBOX, recover_keys
+
+    parser = argparse.ArgumentParser(description="Ciphertexts needed by the vote and by the ML scorer")
+
+    parser.add_argument('-t', '--trials', type=int, default=200,
+                        help='Random keys and fault locations')
+
+    parser.add_argument('--step', type=int, default=100,
+                        help='Ciphertexts between two recovery attempts')
+
+    parser.add_argument('--max', type=int, default=4000,
+                        help='Ciphertexts per trial')
+
+    parser.add_argument('-s', '--seed', type=int, default=1)
+
+    config = parser.parse_args()
+
+    rng = np.random.default_rng(config.seed)
+    sizes = np.arange(config.step, config.max + 1, config.step)
+    success = {"vote": np.zeros(len(sizes)), "ml": np.zeros(len(sizes))}
+    check = 0
+    start = time.perf_counter()
+
+    for trial in range(config.trials):
+        key = rng.bytes(16)
+        simlib.set_fault(int(rng.integers(1, 256)))
+        while (simlib.sbox() == SBOX).all():    # the skip left the S-box clean
+            simlib.set_fault(int(rng.integers(1, 256)))
+        ctx = simlib.setkey(key)
+        pts = simlib.plaintexts(config.seed + trial, 0, config.max)
+        cpts = simlib.encrypt(ctx, pts)
+
+        # A method succeeds when its hypotheses hold the missing values and the
+        # fault value: recover_keys() then finds the key with the first pairs
+        i = int(np.flatnonzero(simlib.sbox() != SBOX)[0])
+        f_true = int(simlib.sbox()[i] ^ SBOX[i])
+        m_true = SBOX[i] ^ simlib.round_keys(ctx)[-1]
+
+        scorer = MLScorer()
+        for s, n in enumerate(sizes):
+            for cpt in cpts[n - config.step:n]:
+                scorer.update(cpt)
+            f, m, _ = scorer.estimate()
+            success["ml"][s] += f == f_true and (m == m_true).all()
+            faults, cmin = vote_estimate(scorer.counter)
+            success["vote"][s] += f_true in faults and (cmin == m_true).all()
+
+        if trial == 0:
+            # The incremental scores against the ones computed from the counts,
+            # and the key recovery end to end
+            assert (MLScorer(scorer.counter).best == scorer.best).all()
+            f, m, _ = scorer.estimate()
+            assert (f == f_true and (m == m_true).all()) == (key in [k for _, _, k in recover_keys(m, [f], pts[:2], cpts[:2])])
+
+    elapsed = time.perf_counter() - start
+    print(f"{config.trials} trials in {elapsed:.1f} s\n")
+    print("    N      vote        ML")
+    for s, n in enumerate(sizes):
+        print(f"{n:5d}  {100 * success['vote'][s] / config.trials:7.1f}%  {100 * success['ml'][s] / config.trials:7.1f}%")
+    for method in ("vote", "ml"):
+        ok = np.flatnonzero(success[method] >= 0.9 * config.trials)
+        needed = sizes[ok[0]] if len(ok) else None
+        print(f"{method:>4}: 90% success with {needed if needed is not None else f'more than {config.max}'} ciphertexts")
@@ -0,0 +1,52 @@
+import ctypes
+import os
+import numpy as np
+
+# Ranked key enumeration of the PFA (faultingsbox/pfaenum.c), built with
+# `cd faultingsbox && make libpfaenum.so`. PFAENUM_LIB overrides the library path.
+LIBRARY = os.environ.get("PFAENUM_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                     "faultingsbox", "libpfaenum.so"))
+MAX_PAIRS = 8
+
+
+class EnumResult(ctypes.Structure):
+    _fields_ = [
+        ("tested",     ctypes.c_uint64),
+        ("rank",       ctypes.c_uint64),
+        ("found",      ctypes.c_int),
+        ("location",   ctypes.c_int),
+        ("f",          ctypes.c_int),
+        ("score",      ctypes.c_int),
+        ("last_rk",    ctypes.c_uint8 * 16),
+        ("master_key", ctypes.c_uint8 * 16),
+    ]
+
+
+_lib = None
+
+def load_library():
+    """The loaded library, or None if it has not been built"""
+    global _lib
+    if _lib is None and os.path.exists(LIBRARY):
+        _lib = ctypes.CDLL(LIBRARY)
+        _lib.pfa_enum_recover.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p,
+                                          ctypes.c_int, ctypes.c_uint64, ctypes.c_int,
+                                          ctypes.POINTER(EnumResult)]
+        _lib.pfa_enum_recover.restype = ctypes.c_int
+    return _lib
+
+def enumerate_keys(counter, pts, cpts, budget, threads=None):
+    """EnumResult of the ranked enumeration from the 16x256 byte counts and
+    plaintext/ciphertext pairs of the faulty device, None without the library"""
+    lib = load_library()
+    if lib is None:
+        return None
+    if threads is None:
+        threads = os.cpu_count() or 1
+    pairs = min(len(pts), MAX_PAIRS)
+    res = EnumResult()
+    lib.pfa_enum_recover(np.ascontiguousarray(counter, dtype="<u8").tobytes(),
+                         np.ascontiguousarray(pts[:pairs], dtype=np.uint8).tobytes(),
+                         np.ascontiguousarray(cpts[:pairs], dtype=np.uint8).tobytes(),
+                         pairs, budget, threads, ctypes.byref(res))
+    return res
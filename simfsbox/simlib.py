@@ -0,0 +1,166 @@
+import argparse
+import ctypes
+import os
+import subprocess
+import tempfile
+import time
+import numpy as np
+from numpy.ctypeslib import ndpointer
+
+# Simulator core of faultingsbox/main.c (table generation with a fault, key
+# setup, batch encryption) built with `cd faultingsbox && make libsim.so`.
+# SIM_LIB overrides the library path. Every function fills the NumPy array it
+# is given (or allocates one) in place, without copies or files.
+LIBRARY = os.environ.get("SIM_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                 "faultingsbox", "libsim.so"))
+SKIP_XOR_CONST = 4
+BYTES = ndpointer(np.uint8, flags="C_CONTIGUOUS")
+WORDS = ndpointer(np.uint32, flags="C_CONTIGUOUS")
+COUNTS = ndpointer(np.uint64, shape=(16, 256), flags="C_CONTIGUOUS")
+
+
+_lib = None
+
+def load_library():
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(LIBRARY)
+        lib.sim_context_size.argtypes = []
+        lib.sim_context_size.restype = ctypes.c_size_t
+        lib.sim_set_fault.argtypes = [ctypes.c_int, ctypes.c_int]
+        lib.sim_set_fault.restype = ctypes.c_int
+        lib.sim_get_sbox.argtypes = [BYTES]
+        lib.sim_get_sbox.restype = None
+        lib.sim_setkey.argtypes = [BYTES, BYTES, ctypes.c_uint]
+        lib.sim_setkey.restype = ctypes.c_int
+        lib.sim_round_keys.argtypes = [BYTES, WORDS]
+        lib.sim_round_keys.restype = ctypes.c_int
+        lib.sim_plaintexts.argtypes = [ctypes.c_uint64, ctypes.c_uint64, BYTES, ctypes.c_size_t]
+        lib.sim_plaintexts.restype = None
+        lib.sim_encrypt.argtypes = [BYTES, BYTES, BYTES, ctypes.c_size_t]
+        lib.sim_encrypt.restype = None
+        lib.sim_count.argtypes = [BYTES, ctypes.c_uint64, ctypes.c_uint64, ctypes.c_uint64, COUNTS]
+        lib.sim_count.restype = None
+        _lib = lib
+    return _lib
+
+
+def _blocks(out, n):
+    """`out` as an (n,16) uint8 array, or a new one"""
+    if out is None:
+        return np.empty((n, 16), dtype=np.uint8)
+    assert out.dtype == np.uint8 and out.size == 16 * n, "Expected a uint8 buffer of n blocks"
+    return out
+
+
+def set_fault(location=-1, op=SKIP_XOR_CONST):
+    """Regenerate the tables with step `op` skipped at S-box index `location`
+    (-1: no fault). Keys set up before keep the round keys of the old S-box."""
+    if load_library().sim_set_fault(location, op) != 0:
+        raise ValueError(f"Invalid fault (location {location}, op {op})")
+
+
+def sbox(out=None):
+    out = np.empty(256, dtype=np.uint8) if out is None else out
+    load_library().sim_get_sbox(out)
+    return out
+
+
+def setkey(key, ctx=None):
+    """Context of `key` (16, 24 or 32 bytes) under the current S-box, in `ctx` if given"""
+    lib = load_library()
+    ctx = np.zeros(lib.sim_context_size(), dtype=np.uint8) if ctx is None else ctx
+    key = np.frombuffer(bytes(key), dtype=np.uint8)
+    if lib.sim_setkey(ctx, key, 8 * len(key)) != 0:
+        raise ValueError(f"Invalid key length {len(key)}")
+    return ctx
+
+
+def round_keys(ctx):
+    """Round keys of `ctx` as an (nr+1,16) uint8 array"""
+    rk = np.empty(4 * 15, dtype=np.uint32)
+    nr = load_library().sim_round_keys(ctx, rk)
+    return rk[:4 * (nr + 1)].astype("<u4").view(np.uint8).reshape(nr + 1, 16)
+
+
+def plaintexts(seed, first, n, out=None):
+    """Plaintexts first..first+n-1 of the stream of `seed`, as faultingsbox/main -s seed"""
+    out = _blocks(out, n)
+    load_library().sim_plaintexts(seed, first, out, n)
+    return out
+
+
+def encrypt(ctx, pts, out=None):
+    """Ciphertexts of the (n,16) plaintexts under the current tables; `out` may be `pts`"""
+    pts = np.ascontiguousarray(pts, dtype=np.uint8)
+    out = _blocks(out, len(pts.reshape(-1, 16)))
+    load_library().sim_encrypt(ctx, pts, out, len(pts.reshape(-1, 16)))
+    return out
+
+
+def count(ctx, seed, first, n, counts=None):
+    """Add the 16x256 byte counts of the ciphertexts of plaintexts
+    first..first+n-1 to `counts` (uint64), without storing them"""
+    counts = np.zeros((16, 256), dtype=np.uint64) if counts is None else counts
+    load_library().sim_count(ctx, seed, first, n, counts)
+    return counts
+
+
+if __name__ == "__main__":
+    from keyrecovery import SBOX, encrypt_batch, inverse_key_schedule_batch, count_bytes
+    from cptsfile import load_ciphertexts
+
+    parser = argparse.ArgumentParser(description="Check libsim.so and time it against process spawns")
+
+    parser.add_argument('-n', '--count', type=int, default=5000,
+                        help='Ciphertexts per fault location')
+
+    parser.add_argument('--spawns', type=int, default=16,
+                        help='Runs of faultingsbox/main to time')
+
+    config = parser.parse_args()
+
+    # FIPS-197 C.1 on the clean tables
+    set_fault(-1)
+    ctx = setkey(bytes(range(16)))
+    cpt = encrypt(ctx, np.frombuffer(bytes.fromhex("00112233445566778899aabbccddeeff"), dtype=np.uint8))
+    assert bytes(cpt[0]).hex() == "69c4e0d86a7b0430d8cdb78070b4c55a"
+
+    # Faulted tables against the NumPy model of keyrecovery.py
+    key = bytes.fromhex("5b12a47f2b5571191ec06d7c02fc6076")
+    pts = plaintexts(3, 0, 64)
+    for location in (0x01, 0x49, 0xff):
+        set_fault(location)
+        fsb = sbox()
+        assert (fsb != SBOX).sum() == 1 and fsb[location] != SBOX[location]
+        ctx = setkey(key)
+        rks = round_keys(ctx)
+        assert bytes(inverse_key_schedule_batch(fsb[None], rks[None, 10])[0, 0]) == key
+        assert (encrypt(ctx, pts) == encrypt_batch(fsb[None], rks[None], pts)[0]).all()
+        assert (count(ctx, 3, 0, 64) == count_bytes(encrypt(ctx, pts))).all()
+    print("[PASSED] libsim.so against FIPS-197 and keyrecovery.py")
+
+    # Byte counts of every fault location, in process
+    counts = np.zeros((16, 256), dtype=np.uint64)
+    start = time.perf_counter()
+    for location in range(1, 256):
+        set_fault(location)
+        counts[:] = 0
+        count(setkey(key), 1, 0, config.count, counts)
+    lib_time = (time.perf_counter() - start) / 255
+
+    # The same through faultingsbox/main and a ciphertext file
+    main = os.path.join(os.path.dirname(LIBRARY), "main")
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "cpts.bin")
+        start = time.perf_counter()
+        for location in range(1, config.spawns + 1):
+            subprocess.run([main, "-m", "fixed", "-l", str(location), "-s", "1", "-n", str(config.count),
+                            "-o", path], check=True, stdout=subprocess.DEVNULL)
+            spawned = count_bytes(load_ciphertexts(path))
+        spawn_time = (time.perf_counter() - start) / config.spawns
+    set_fault(config.spawns)
+    assert (count(setkey(key), 1, 0, config.count) == spawned).all()
+
+    print(f"{config.count} ciphertexts per fault location: {1e3 * lib_time:.2f} ms in process, "
+          f"{1e3 * spawn_time:.2f} ms through faultingsbox/main ({spawn_time / lib_time:.1f}x)")
@@ -0,0 +1,49 @@
+import numpy as np
+import argparse
+
+
+def load_sweep(path):
+    """Columns location, key_index, key_schedule, decided, recovered, ciphertexts of a sweep table"""
+    table = np.loadtxt(path, delimiter=',', skiprows=1, usecols=(0, 1, 3, 4, 5, 6), dtype=np.int64, ndmin=2)
+    return tuple(table.T)
+
+def print_grid(title, values, fmt):
+    print(title)
+    print("    " + "".join("%6x" % l for l in range(16)))
+    for h in range(16):
+        print("%2x |" % h + "".join(fmt(v) for v in values[16*h:16*h+16]))
+    print()
+
+def summarize(path):
+    location, key_index, key_schedule, decided, recovered, n = load_sweep(path)
+    keys = key_index.max() + 1
+
+    runs = np.bincount(location, minlength=256)
+    success = np.bincount(location, weights=recovered, minlength=256)
+    cost = np.bincount(location, weights=n * recovered, minlength=256)
+    rate = np.divide(success, runs, out=np.zeros(256), where=runs > 0)
+    mean = np.divide(cost, success, out=np.full(256, np.nan), where=success > 0)
+
+    print("%d runs, %d keys per fault location" % (len(location), keys))
+    print_grid("Success rate (%) per faulted S-box index (row: high nibble, column: low nibble)",
+               100 * rate, lambda v: "%6.0f" % v)
+    print_grid("Mean ciphertexts to recovery",
+               mean, lambda v: "     -" if np.isnan(v) else "%6.0f" % v)
+    print("Key recovered in %d/%d runs, %d/%d locations always succeed, %d never"
+          % (recovered.sum(), len(location), (rate[runs > 0] == 1).sum(), (runs > 0).sum(),
+             (rate[runs > 0] == 0).sum()))
+    for used, name in ((1, "read"), (0, "not read")):
+        sel = key_schedule == used
+        if sel.any():
+            print("Faulted entry %s by the key schedule: %d runs, key recovered in %.1f%%"
+                  % (name, sel.sum(), 100 * recovered[sel].mean()))
+    if recovered.any():
+        print("Ciphertexts to recovery: median %d, 95th percentile %d"
+              % (np.median(n[recovered == 1]), np.percentile(n[recovered == 1], 95)))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Success-rate tables of an online fault-location sweep")
+    parser.add_argument('path', nargs='?', default='sweep.csv', help="table written by main --model sweep --online")
+    args = parser.parse_args()
+    summarize(args.path)
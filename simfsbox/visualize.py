@@ -1,6 +1,9 @@
 from matplotlib import pyplot as plt
 import numpy as np
 import argparse
+from cptsfile import iter_ciphertexts, describe
+from freqcurves import sample_points, frequency_curves
+
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
@@ -8,49 +11,49 @@ if __name__ == "__main__":
     parser.add_argument('--path-to-file', dest='path_to_file',
                         type=str,
                         default='cpts.txt',
-                        help='Path to the ciphertext file')
+                        help='Path to the ciphertext file (hex text or .bin container)')
  
     parser.add_argument('--byte-index', dest='j',
                         type=int,
                         default=15,
                         help='ciphertext byte index in [0,15]')
 
+    parser.add_argument('--step', dest='step',
+                        type=int,
+                        default=0,
+                        help='Number of ciphertexts between two plotted points (0: about 1000 points)')
+
+    parser.add_argument('--log-points', dest='log_points',
+                        type=int,
+                        default=0,
+                        help='Plot this many log-spaced points instead of one every --step ciphertexts')
+
     config = parser.parse_args()
 
-    with open(config.path_to_file, "r") as f: cpts = f.readlines()
-    cpts = [bytes.fromhex(c.strip()) for c in cpts]
-    N = len(cpts)
+    # Only the requested byte is kept in memory
+    j = config.j
+    column = np.concatenate([c[:, j] for c in iter_ciphertexts(config.path_to_file, 1 << 20)])
+    N = len(column)
     print(f"There are {N} ciphertexts")
+    if describe(config.path_to_file): print(describe(config.path_to_file))
 
-    counter = np.zeros((16,256), dtype=np.uint32)
-    step = 10
-    assert N % step == 0
-    probs = np.zeros((N//step,16,256), dtype=np.float32)
-    for i in range(N):
-        n = i+1
-        for j in range(16):
-            counter[j][cpts[i][j]] += 1
-        if n % step == 0:
-            for j in range(16):
-                for v in range(256):
-                    probs[n//step-1,j,v] = counter[j,v] / n
+    xrange = sample_points(N, config.step, config.log_points)
+    probs = frequency_curves(column, xrange)
 
-
-    j = config.j
-    cmax = np.argmax(probs[N//step-1,j,:])
-    cmin = np.argmin(probs[N//step-1,j,:])
+    cmax = np.argmax(probs[-1])
+    cmin = np.argmin(probs[-1])
     print(f"cmax = {cmax}")
     print(f"cmin = {cmin}")
-    xrange = [x+step for x in range(0,N,step)]
     already_labeled = False
     for v in range(256):
-        if v == cmax: plt.plot(xrange, probs[:,j,v], color="red", label=r"$c^{max}_j$")
-        elif v == cmin: plt.plot(xrange, probs[:,j,v], color="blue", label=r"$c^{min}_j$")
+        if v == cmax: plt.plot(xrange, probs[:,v], color="red", label=r"$c^{max}_j$")
+        elif v == cmin: plt.plot(xrange, probs[:,v], color="blue", label=r"$c^{min}_j$")
         elif not already_labeled: 
-            plt.plot(xrange, probs[:,j,v], color="lightgray", label=r"others")
+            plt.plot(xrange, probs[:,v], color="lightgray", label=r"others")
             already_labeled = True
-        else: plt.plot(xrange, probs[:,j,v], color="lightgray")
+        else: plt.plot(xrange, probs[:,v], color="lightgray")
 
+    if config.log_points > 0: plt.xscale("log")
     plt.ylim((-0.0005, 0.015))
     plt.xlabel("Number of ciphertexts")
     plt.ylabel("Frequency")